@@ -23,7 +23,6 @@
 #include "dax.h"
 #include <config.h>
 
-extern Dax dax;
 
 AddTagDialog::AddTagDialog(QWidget *parent) : QDialog(parent) {
     setupUi(this);
@@ -24,23 +24,23 @@
 #include "dax.h"
 #include <config.h>
 
-extern Dax dax;
 
 
-TypeItem::TypeItem(QTreeWidget *parent, QString name, tag_type type, uint32_t count) : QTreeWidgetItem(parent) {
+TypeItem::TypeItem(QTreeWidget *parent, Dax *dax, QString name, tag_type type, uint32_t count) : QTreeWidgetItem(parent) {
     this->name = name;
     this->type = type;
     this->count = count;
 
-    typestr = dax.typeString(type, count)->c_str();
+    typestr = dax->typeString(type, count)->c_str();
     setData(0, Qt::DisplayRole, name);
     setData(1, Qt::DisplayRole, typestr);
 }
 
 
-AddTypeDialog::AddTypeDialog(QWidget *parent) : QDialog(parent) {
+AddTypeDialog::AddTypeDialog(Dax *dax, QWidget *parent) : QDialog(parent) {
     std::vector<type_id> types;
 
+    this->dax = dax;
     setupUi(this);
 
     treeWidget->setColumnCount(2);
@@ -50,7 +50,7 @@ AddTypeDialog::AddTypeDialog(QWidget *parent) : QDialog(parent) {
 
     QObject::connect(pushButtonAdd, &QPushButton::clicked, this, &AddTypeDialog::addMember);
 
-    types = dax.getTypes();
+    types = dax->getTypes();
     for(type_id type : types) {
         comboBoxType->addItem(QString(type.name.c_str()), type.type);
     }
@@ -77,6 +77,6 @@ AddTypeDialog::addMember(void) {
     lineEditMemberName->setFocus(Qt::OtherFocusReason);
     lineEditMemberName->selectAll();
 
-    item = new TypeItem(treeWidget, name, type, count);
+    item = new TypeItem(treeWidget, dax, name, type, count);
     treeWidget->addTopLevelItem(item);
 }
\ No newline at end of file
@@ -34,7 +34,7 @@ class TypeItem : public QTreeWidgetItem
         tag_type type;
         uint32_t count;
 
-        TypeItem(QTreeWidget *parent, QString name, tag_type type, uint32_t count);
+        TypeItem(QTreeWidget *parent, Dax *dax, QString name, tag_type type, uint32_t count);
 
 };
 
@@ -44,10 +44,11 @@ class AddTypeDialog : public QDialog, public Ui_AddTypeDialog
     Q_OBJECT
 
     private:
+        Dax *dax;
         void addMember(void);
 
     public:
-        explicit AddTypeDialog(QWidget *parent = nullptr);
+        explicit AddTypeDialog(Dax *dax, QWidget *parent = nullptr);
         ~AddTypeDialog();
 
     public slots:
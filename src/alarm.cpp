@@ -0,0 +1,231 @@
+/*  qDAX - An open source data acquisition and control system
+ *  Copyright (c) 2023 Phil Birkelbach
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+
+ *  Source code file for the client side alarms
+ */
+
+#include <cmath>
+#include <algorithm>
+#include <QDateTime>
+#include <QBrush>
+#include "qdax.h"
+#include "alarm.h"
+
+
+AlarmEngine::AlarmEngine(ExprEngine *exprs) {
+    _exprs = exprs;
+    _nextId = 0;
+    _active = 0;
+    _timer = new QTimer(this);
+    QObject::connect(_timer, &QTimer::timeout, this, &AlarmEngine::_check);
+    _timer->start(ALARM_CHECK_TIME);
+}
+
+
+AlarmEngine::~AlarmEngine() {
+    for(int id : _alarms.keys()) remove(id);
+}
+
+
+/* Keeps count of the active alarms so that we know which one was first
+   out, the one that came in while everything else was normal.  Only the
+   changes are sent to the GUI. */
+void
+AlarmEngine::_set(Alarm *a, bool active, double value, qint64 now) {
+    if(active == a->active) return;
+    a->active = active;
+    if(active) {
+        a->firstOut = (_active == 0);
+        a->since = now;
+        _active++;
+    } else {
+        a->firstOut = false;
+        _active--;
+    }
+    emit changed(a->id, active, a->firstOut, value, a->since);
+}
+
+
+/* Expression callback.  This is called on the event thread for every new
+   value so it has to stay cheap. */
+void
+AlarmEngine::_evaluate(Expression *expr, double value, void *udata) {
+    Alarm *a = (Alarm *)udata;
+    qint64 now = QDateTime::currentMSecsSinceEpoch();
+    double rate;
+    bool active;
+
+    std::lock_guard<std::mutex> lock(a->engine->_lock);
+    active = a->active;
+    switch(a->kind) {
+        case ALARM_HIGH:
+            active = a->active ? value > a->limit - a->deadband : value > a->limit;
+            break;
+        case ALARM_LOW:
+            active = a->active ? value < a->limit + a->deadband : value < a->limit;
+            break;
+        case ALARM_RATE:
+            if(value == a->last) break;
+            rate = std::fabs(value - a->last) * 1000.0 / std::max<qint64>(now - a->lastChange, 1);
+            active = a->active ? rate > a->limit - a->deadband : rate > a->limit;
+            break;
+        case ALARM_STUCK:
+            if(value != a->last) active = false;
+            break;
+        case ALARM_TRIP:
+            active = value != 0.0;
+            break;
+    }
+    if(value != a->last) {
+        a->last = value;
+        a->lastChange = now;
+    }
+    a->engine->_set(a, active, value, now);
+}
+
+
+/* Stuck values and rates that have gone flat don't send us any events so
+   they are found here */
+void
+AlarmEngine::_check(void) {
+    qint64 now = QDateTime::currentMSecsSinceEpoch();
+
+    std::lock_guard<std::mutex> lock(_lock);
+    for(Alarm *a : _alarms) {
+        if(a->kind == ALARM_STUCK && !a->active && now - a->lastChange > a->limit * 1000.0) {
+            _set(a, true, a->last, now);
+        } else if(a->kind == ALARM_RATE && a->active && now - a->lastChange > ALARM_CHECK_TIME) {
+            _set(a, false, a->last, now);
+        }
+    }
+}
+
+
+/* Returns the id of the new alarm or an error code.  If the expression
+   won't compile the reason is put in error. */
+int
+AlarmEngine::add(int kind, QString text, double limit, double deadband, QString *error) {
+    Alarm *a;
+    int result;
+
+    a = new Alarm(text);
+    a->id = _nextId++;
+    a->kind = kind;
+    a->limit = limit;
+    a->deadband = deadband;
+    a->engine = this;
+    a->active = false;
+    a->firstOut = false;
+    a->last = NAN;
+    a->lastChange = QDateTime::currentMSecsSinceEpoch();
+    a->since = 0;
+    a->expr.callback = _evaluate;
+    a->expr.udata = a;
+    /* This evaluates it for the first time too */
+    result = _exprs->add(&a->expr, error);
+    if(result) {
+        delete a;
+        return result;
+    }
+    _alarms.insert(a->id, a);
+    return a->id;
+}
+
+
+void
+AlarmEngine::remove(int id) {
+    Alarm *a = _alarms.value(id, nullptr);
+
+    if(a == nullptr) return;
+    /* No more callbacks once this returns */
+    _exprs->remove(&a->expr);
+    std::lock_guard<std::mutex> lock(_lock);
+    if(a->active) _active--;
+    _alarms.remove(id);
+    delete a;
+}
+
+
+/* Gets the part of the alarm that belongs to the lock */
+void
+AlarmEngine::state(Alarm *a, bool *active, bool *firstOut, double *value, qint64 *since) {
+    std::lock_guard<std::mutex> lock(_lock);
+    *active = a->active;
+    *firstOut = a->firstOut;
+    *value = a->last;
+    *since = a->since;
+}
+
+
+QString
+AlarmEngine::kindName(int kind) {
+    switch(kind) {
+        case ALARM_HIGH:  return "High";
+        case ALARM_LOW:   return "Low";
+        case ALARM_RATE:  return "Rate of Change";
+        case ALARM_STUCK: return "Stuck";
+        case ALARM_TRIP:  return "Trip";
+    }
+    return "Unknown";
+}
+
+
+QString
+AlarmEngine::condition(Alarm *a) {
+    QString s;
+
+    switch(a->kind) {
+        case ALARM_HIGH:  s = QString("> %1").arg(a->limit); break;
+        case ALARM_LOW:   s = QString("< %1").arg(a->limit); break;
+        case ALARM_RATE:  s = QString("Rate > %1/s").arg(a->limit); break;
+        case ALARM_STUCK: return QString("Unchanged %1 s").arg(a->limit);
+        case ALARM_TRIP:  return "True";
+    }
+    if(a->deadband > 0.0) s += QString(" (deadband %1)").arg(a->deadband);
+    return s;
+}
+
+
+/* The first evaluation happens in AlarmEngine::add() before there is an
+   item to get the changed() signal, so we start from the alarm's state */
+AlarmItem::AlarmItem(QTreeWidget *parent, Alarm *a) : QTreeWidgetItem(parent) {
+    bool active, firstOut;
+    double value;
+    qint64 since;
+
+    id = a->id;
+    setData(ALARM_NAME_COLUMN, Qt::DisplayRole, a->expr.text());
+    setData(ALARM_CONDITION_COLUMN, Qt::DisplayRole, AlarmEngine::condition(a));
+    a->engine->state(a, &active, &firstOut, &value, &since);
+    update(active, firstOut, value, since);
+}
+
+
+void
+AlarmItem::update(bool active, bool firstOut, double value, qint64 since) {
+    if(active) {
+        setData(ALARM_STATE_COLUMN, Qt::DisplayRole, firstOut ? "First Out" : "Active");
+        setData(ALARM_TIME_COLUMN, Qt::DisplayRole, QDateTime::fromMSecsSinceEpoch(since).toString("hh:mm:ss.zzz"));
+        for(int n=0; n <= ALARM_TIME_COLUMN; n++) setBackground(n, QBrush(firstOut ? Qt::red : QColor(255, 160, 160)));
+    } else {
+        setData(ALARM_STATE_COLUMN, Qt::DisplayRole, "Normal");
+        setData(ALARM_TIME_COLUMN, Qt::DisplayRole, QVariant());
+        for(int n=0; n <= ALARM_TIME_COLUMN; n++) setBackground(n, QBrush());
+    }
+    if(!std::isnan(value)) setData(ALARM_VALUE_COLUMN, Qt::DisplayRole, value);
+}
@@ -0,0 +1,117 @@
+/*  qDAX - An open source data acquisition and control system
+ *  Copyright (c) 2023 Phil Birkelbach
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+
+ *  Header file for the client side alarms
+ */
+
+#ifndef ALARM_H
+#define ALARM_H
+
+#include <QObject>
+#include <QTimer>
+#include <QHash>
+#include <QTreeWidget>
+#include <mutex>
+#include "expression.h"
+
+#define ALARM_HIGH  0
+#define ALARM_LOW   1
+#define ALARM_RATE  2
+#define ALARM_STUCK 3
+#define ALARM_TRIP  4
+
+#define ALARM_NAME_COLUMN 0
+#define ALARM_CONDITION_COLUMN 1
+#define ALARM_STATE_COLUMN 2
+#define ALARM_VALUE_COLUMN 3
+#define ALARM_TIME_COLUMN 4
+
+/* How often we look for stuck values and rates that have stopped */
+#define ALARM_CHECK_TIME 1000
+
+class AlarmEngine;
+
+/* An alarm watches the result of an expression, which is usually just a
+   tag name.  The limit is in the units of the value for high and low, units
+   per second for rate and seconds for stuck.  The deadband is how far the
+   value has to come back past the limit before the alarm clears. */
+struct Alarm {
+    int id;
+    int kind;
+    double limit;
+    double deadband;
+    Expression expr;
+    AlarmEngine *engine;
+    /* Everything below here belongs to the engine's lock */
+    bool active;
+    bool firstOut;
+    double last;
+    qint64 lastChange;
+    qint64 since;
+
+    Alarm(QString text) : expr(text) {};
+};
+
+/* Alarms are checked in the expression callback so they are evaluated on
+   the event thread as each value comes in.  Only the changes of state are
+   passed on to the GUI by the changed() signal. */
+class AlarmEngine : public QObject
+{
+    Q_OBJECT
+
+    private:
+        ExprEngine *_exprs;
+        std::mutex _lock;
+        QHash<int, Alarm *> _alarms;
+        QTimer *_timer;
+        int _nextId;
+        int _active;
+
+        static void _evaluate(Expression *expr, double value, void *udata);
+        void _set(Alarm *a, bool active, double value, qint64 now);
+
+    private slots:
+        void _check(void);
+
+    signals:
+        void changed(int id, bool active, bool firstOut, double value, qint64 since);
+
+    public:
+        AlarmEngine(ExprEngine *exprs);
+        ~AlarmEngine();
+
+        int add(int kind, QString text, double limit, double deadband, QString *error);
+        void remove(int id);
+        QList<Alarm *> alarms(void) { return _alarms.values(); };
+        Alarm *alarm(int id) { return _alarms.value(id, nullptr); };
+        void state(Alarm *a, bool *active, bool *firstOut, double *value, qint64 *since);
+        static QString kindName(int kind);
+        static QString condition(Alarm *a);
+};
+
+/* One alarm in the alarms panel */
+class AlarmItem : public QTreeWidgetItem
+{
+    public:
+        int id;
+
+        AlarmItem(QTreeWidget *parent, Alarm *a);
+        void update(bool active, bool firstOut, double value, qint64 since);
+};
+
+#endif
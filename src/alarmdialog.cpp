@@ -0,0 +1,48 @@
+/*  qDAX - An open source data acquisition and control system
+ *  Copyright (c) 2023 Phil Birkelbach
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+
+ *  Source code file for the add alarm dialog box
+ */
+
+#include "alarmdialog.h"
+#include "alarm.h"
+
+
+AlarmDialog::AlarmDialog(QWidget *parent) : QDialog(parent) {
+    setupUi(this);
+    for(int kind = ALARM_HIGH; kind <= ALARM_TRIP; kind++) {
+        comboBoxKind->addItem(AlarmEngine::kindName(kind), kind);
+    }
+    QObject::connect(comboBoxKind, &QComboBox::currentIndexChanged, this, &AlarmDialog::kindChanged);
+    kindChanged(0);
+}
+
+
+/* The limit means something different for each kind of alarm */
+void
+AlarmDialog::kindChanged(int index) {
+    int kind = comboBoxKind->itemData(index).toInt();
+
+    switch(kind) {
+        case ALARM_RATE:  labelLimit->setText("Units/s:"); break;
+        case ALARM_STUCK: labelLimit->setText("Seconds:"); break;
+        default:          labelLimit->setText("Limit:"); break;
+    }
+    doubleSpinBoxLimit->setEnabled(kind != ALARM_TRIP);
+    doubleSpinBoxDeadband->setEnabled(kind == ALARM_HIGH || kind == ALARM_LOW || kind == ALARM_RATE);
+}
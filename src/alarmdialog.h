@@ -0,0 +1,39 @@
+/*  qDAX - An open source data acquisition and control system
+ *  Copyright (c) 2023 Phil Birkelbach
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+
+ *  Header file for the add alarm dialog box
+ */
+
+#ifndef _ALARM_DIALOG_H
+#define _ALARM_DIALOG_H
+
+#include "ui_alarmdialog.h"
+
+
+class AlarmDialog : public QDialog, public Ui_AlarmDialog
+{
+    Q_OBJECT
+
+    public:
+        explicit AlarmDialog(QWidget *parent = nullptr);
+
+    public slots:
+        void kindChanged(int index);
+};
+
+#endif
@@ -0,0 +1,150 @@
+/*  qDAX - An open source data acquisition and control system
+ *  Copyright (c) 2023 Phil Birkelbach
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+
+ *  Source code file for the arena that holds the client side tag buffers
+ */
+
+#include <cstdlib>
+#include <cstring>
+#include "arena.h"
+
+TagArena::TagArena(int planes, size_t chunksize) {
+    _planes = planes;
+    _chunksize = chunksize;
+    _live = 0;
+}
+
+
+TagArena::~TagArena() {
+    clear();
+}
+
+
+/* Buffers that are larger than a quarter of a chunk get a dedicated chunk
+   of just their size so that we don't waste the end of the current one.
+   Otherwise the new chunk is a full size one and becomes the current. */
+ArenaChunk *
+TagArena::_newChunk(size_t size, bool dedicated) {
+    ArenaChunk chunk;
+
+    if(!dedicated) size = _chunksize;
+    chunk.base = (uint8_t *)calloc(_planes, size);
+    if(chunk.base == NULL) return NULL;
+    chunk.size = size;
+    chunk.used = 0;
+    /* The dedicated ones go in front of the current chunk so that it stays
+       last */
+    if(dedicated && !_chunks.empty()) {
+        _chunks.insert(_chunks.end() - 1, chunk);
+        return &_chunks[_chunks.size() - 2];
+    }
+    _chunks.push_back(chunk);
+    return &_chunks.back();
+}
+
+
+/* Returns a zeroed buffer of at least size bytes in plane 0, or NULL if
+   we are out of memory */
+void *
+TagArena::alloc(size_t size) {
+    ArenaChunk *chunk;
+    uint8_t *p;
+
+    size = _round(size);
+    if(size == 0) size = ARENA_ALIGN;
+
+    auto list = _freelists.find(size);
+    if(list != _freelists.end() && !list->second.empty()) {
+        p = list->second.back();
+        list->second.pop_back();
+        for(int n=0;n<_planes;n++) {
+            memset(plane(p, n), 0, size);
+        }
+        _live += size;
+        return p;
+    }
+
+    if(size > _chunksize / 4) {
+        chunk = _newChunk(size, true);
+    } else if(_chunks.empty() || _chunks.back().size - _chunks.back().used < size) {
+        chunk = _newChunk(_chunksize, false);
+    } else {
+        chunk = &_chunks.back();
+    }
+    if(chunk == NULL) return NULL;
+    p = chunk->base + chunk->used;
+    chunk->used += size;
+    _live += size;
+    return p;
+}
+
+
+void
+TagArena::free(void *p, size_t size) {
+    if(p == NULL) return;
+    size = _round(size);
+    if(size == 0) size = ARENA_ALIGN;
+    _freelists[size].push_back((uint8_t *)p);
+    _live -= size;
+}
+
+
+/* Returns the buffer in the given plane that is at the same position as
+   the plane 0 buffer p */
+void *
+TagArena::plane(void *p, int plane) {
+    uint8_t *b = (uint8_t *)p;
+
+    for(ArenaChunk &chunk : _chunks) {
+        if(b >= chunk.base && b < chunk.base + chunk.size) {
+            return b + chunk.size * plane;
+        }
+    }
+    return NULL;
+}
+
+
+/* Releases all of the memory.  Any buffers that are still out are no
+   longer valid after this. */
+void
+TagArena::clear(void) {
+    for(ArenaChunk &chunk : _chunks) {
+        ::free(chunk.base);
+    }
+    _chunks.clear();
+    _freelists.clear();
+    _live = 0;
+}
+
+
+ArenaStats
+TagArena::stats(void) {
+    ArenaStats st;
+
+    st.reserved = 0;
+    st.free = 0;
+    for(ArenaChunk &chunk : _chunks) {
+        st.reserved += chunk.size * _planes;
+    }
+    for(auto &list : _freelists) {
+        st.free += list.first * list.second.size() * _planes;
+    }
+    st.live = _live * _planes;
+    st.chunks = _chunks.size();
+    return st;
+}
@@ -0,0 +1,82 @@
+/*  qDAX - An open source data acquisition and control system
+ *  Copyright (c) 2023 Phil Birkelbach
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+
+ *  Header file for the arena that holds the client side tag buffers
+ */
+
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include <unordered_map>
+
+#define ARENA_CHUNK_SIZE 1048576
+#define ARENA_ALIGN 16
+
+/* Each chunk is one block of memory that holds 'planes' copies of the same
+   layout one after the other.  Plane 0 starts at base, plane 1 starts at
+   base + size and so on.  Because every plane has the same layout a buffer
+   in one plane can be compared or copied to the same buffer in another
+   plane, or a whole plane can be done at once. */
+struct ArenaChunk {
+    uint8_t *base;
+    size_t size;  /* Size of a single plane */
+    size_t used;  /* Bytes handed out from the front of each plane */
+};
+
+struct ArenaStats {
+    size_t reserved;  /* Total bytes of all chunks and all planes */
+    size_t live;      /* Bytes in buffers that are in use */
+    size_t free;      /* Bytes sitting in the free lists */
+    size_t chunks;
+};
+
+/* Allocator for tag buffers.  Buffers are handed out from the front of the
+   current chunk so buffers allocated in tag index order are laid out in
+   that order.  Freed buffers are kept in free lists by size and handed out
+   again for the same size.  Pointers stay valid until the buffer is freed
+   or the arena is cleared.  This is not thread safe and should only be
+   used from the GUI thread. */
+class TagArena
+{
+    private:
+        int _planes;
+        size_t _chunksize;
+        size_t _live;
+        std::vector<ArenaChunk> _chunks;
+        std::unordered_map<size_t, std::vector<uint8_t *>> _freelists;
+
+        static size_t _round(size_t size) { return (size + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1); };
+        ArenaChunk *_newChunk(size_t size, bool dedicated);
+
+    public:
+        TagArena(int planes = 1, size_t chunksize = ARENA_CHUNK_SIZE);
+        ~TagArena();
+
+        void *alloc(size_t size);
+        void free(void *p, size_t size);
+        void *plane(void *p, int plane);
+        void clear(void);
+        int planes(void) { return _planes; };
+        const std::vector<ArenaChunk> &chunks(void) { return _chunks; };
+        ArenaStats stats(void);
+};
+
+#endif
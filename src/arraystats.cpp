@@ -0,0 +1,173 @@
+/*  qDAX - An open source data acquisition and control system
+ *  Copyright (c) 2023 Phil Birkelbach
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+
+ *  Source code file for the numeric array statistics functions.
+ *
+ *  Each kernel is a pair of branch free loops marked with OpenMP simd
+ *  reductions.  That gives the compiler permission to reorder the floating
+ *  point sums so that it can turn them into vector instructions for
+ *  whatever target we are built for.  The mean is found first and the
+ *  deviation is summed in a second pass since that is a lot better behaved
+ *  than summing the squares in one pass.
+ */
+
+#include <cmath>
+#include <limits>
+#include <algorithm>
+#include <type_traits>
+#include "arraystats.h"
+
+/* Number of values that are summed in the native type before the partial
+   sum is added to the double total */
+#define STATS_BLOCK 4096
+
+/* Integer types.  A is the type used to accumulate the sum */
+template<typename T, typename A>
+static void
+_int_stats(const T *p, uint32_t count, ArrayStats *s) {
+    T min = p[0], max = p[0];
+    A sum = 0;
+    double mean, sq = 0.0;
+
+#pragma omp simd reduction(min:min) reduction(max:max) reduction(+:sum)
+    for(uint32_t n=0;n<count;n++) {
+        min = p[n] < min ? p[n] : min;
+        max = p[n] > max ? p[n] : max;
+        sum += p[n];
+    }
+    mean = (double)sum / count;
+
+#pragma omp simd reduction(+:sq)
+    for(uint32_t n=0;n<count;n++) {
+        double d = (double)p[n] - mean;
+        sq += d * d;
+    }
+
+    s->min = min;
+    s->max = max;
+    s->mean = mean;
+    s->stddev = std::sqrt(sq / count);
+    s->count = count;
+    s->nans = 0;
+}
+
+
+/* Floating point types.  NaN's fail every comparison so they fall out of
+   the min and max on their own.  We mask them out of the sums and count
+   them.  The sums are done in T a block at a time, so that the loops don't
+   have to convert every value, and the blocks are added up in double. */
+template<typename T>
+static void
+_float_stats(const T *p, uint32_t count, ArrayStats *s) {
+    T min = std::numeric_limits<T>::infinity();
+    T max = -std::numeric_limits<T>::infinity();
+    double sum = 0.0, mean, sq = 0.0;
+    uint32_t nans = 0, base, end;
+
+    for(base=0;base<count;base+=STATS_BLOCK) {
+        end = std::min(count, base + STATS_BLOCK);
+        T bsum = 0;
+        /* Keeping the counter the same width as T keeps the lanes lined up */
+        typename std::conditional<sizeof(T) == 8, uint64_t, uint32_t>::type bnans = 0;
+#pragma omp simd reduction(min:min) reduction(max:max) reduction(+:bsum,bnans)
+        for(uint32_t n=base;n<end;n++) {
+            T x = p[n];
+            min = x < min ? x : min;
+            max = x > max ? x : max;
+            bsum += (x == x) ? x : (T)0;
+            bnans += (x != x);
+        }
+        sum += bsum;
+        nans += bnans;
+    }
+    if(nans == count) {
+        s->min = s->max = s->mean = s->stddev = std::numeric_limits<double>::quiet_NaN();
+        s->count = 0;
+        s->nans = nans;
+        return;
+    }
+    mean = sum / (count - nans);
+
+    for(base=0;base<count;base+=STATS_BLOCK) {
+        end = std::min(count, base + STATS_BLOCK);
+        T bsq = 0;
+        T m = (T)mean;
+#pragma omp simd reduction(+:bsq)
+        for(uint32_t n=base;n<end;n++) {
+            T x = p[n];
+            T d = (x == x) ? x - m : (T)0;
+            bsq += d * d;
+        }
+        sq += bsq;
+    }
+
+    s->min = min;
+    s->max = max;
+    s->mean = mean;
+    s->stddev = std::sqrt(sq / (count - nans));
+    s->count = count - nans;
+    s->nans = nans;
+}
+
+
+/* Compute the statistics of count values of the given type that start at
+   data.  Returns ERR_BADTYPE for types that we don't do statistics on,
+   which are BOOL, CHAR, TIME and the compound types. */
+int
+array_stats(tag_type type, const void *data, uint32_t count, ArrayStats *stats) {
+    if(count == 0) return ERR_ARG;
+
+    switch(type) {
+        case DAX_BYTE:
+            _int_stats<uint8_t, int64_t>((const uint8_t *)data, count, stats);
+            break;
+        case DAX_SINT:
+            _int_stats<int8_t, int64_t>((const int8_t *)data, count, stats);
+            break;
+        case DAX_WORD:
+        case DAX_UINT:
+            _int_stats<uint16_t, int64_t>((const uint16_t *)data, count, stats);
+            break;
+        case DAX_INT:
+            _int_stats<int16_t, int64_t>((const int16_t *)data, count, stats);
+            break;
+        case DAX_DWORD:
+        case DAX_UDINT:
+            _int_stats<uint32_t, int64_t>((const uint32_t *)data, count, stats);
+            break;
+        case DAX_DINT:
+            _int_stats<int32_t, int64_t>((const int32_t *)data, count, stats);
+            break;
+        case DAX_LWORD:
+        case DAX_ULINT:
+            _int_stats<uint64_t, double>((const uint64_t *)data, count, stats);
+            break;
+        case DAX_LINT:
+            _int_stats<int64_t, double>((const int64_t *)data, count, stats);
+            break;
+        case DAX_REAL:
+            _float_stats<float>((const float *)data, count, stats);
+            break;
+        case DAX_LREAL:
+            _float_stats<double>((const double *)data, count, stats);
+            break;
+        default:
+            return ERR_BADTYPE;
+    }
+    return ERR_OK;
+}
@@ -0,0 +1,38 @@
+/*  qDAX - An open source data acquisition and control system
+ *  Copyright (c) 2023 Phil Birkelbach
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+
+ *  Header file for the numeric array statistics functions
+ */
+
+#ifndef ARRAYSTATS_H
+#define ARRAYSTATS_H
+
+#include <opendax.h>
+
+struct ArrayStats {
+    double min;
+    double max;
+    double mean;
+    double stddev;
+    uint32_t count; /* Number of values that went into the statistics */
+    uint32_t nans;  /* Number of NaN values that were skipped */
+};
+
+int array_stats(tag_type type, const void *data, uint32_t count, ArrayStats *stats);
+
+#endif
@@ -0,0 +1,197 @@
+/*  qDAX - An open source data acquisition and control system
+ *  Copyright (c) 2023 Phil Birkelbach
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+
+ *  Source code file for the paged array view dialog
+ */
+
+#include <algorithm>
+#include <cstring>
+#include <QScrollBar>
+#include <QHeaderView>
+#include "qdax.h"
+#include "arrayview.h"
+#include "bitdiff.h"
+
+/* The BOOL strings are only made once */
+static const QString _true = QStringLiteral("true");
+static const QString _false = QStringLiteral("false");
+
+
+ArrayModel::ArrayModel(Dax *dax, QString tagname, tag_handle h, QObject *parent) : QAbstractTableModel(parent) {
+    this->dax = dax;
+    _tagname = tagname.toStdString();
+    _h = h;
+    _first = 0;
+    _valid = false;
+    _compare = false;
+}
+
+
+int
+ArrayModel::rowCount(const QModelIndex &parent) const {
+    if(parent.isValid()) return 0;
+    return _h.count;
+}
+
+
+int
+ArrayModel::columnCount(const QModelIndex &parent) const {
+    if(parent.isValid()) return 0;
+    return 1;
+}
+
+
+/* Only rows that are inside the page that we have read get a value. The
+   view only asks for the rows that are visible so this is the only place
+   that values are formatted. */
+QVariant
+ArrayModel::data(const QModelIndex &index, int role) const {
+    uint32_t n, bit;
+
+    if(!index.isValid() || role != Qt::DisplayRole || !_valid) return QVariant();
+    if(index.row() < _first || index.row() >= _first + (int)_pageh.count) return QVariant();
+
+    n = index.row() - _first;
+    if(_h.type == DAX_BOOL) {
+        bit = _pageh.bit + n;
+        if(_page[bit / 8] & (uint8_t)(0x01 << (bit % 8))) return _true;
+        else                                              return _false;
+    }
+    return QString(dax->valueString(_h.type, (void *)_page.data(), n).c_str());
+}
+
+
+QVariant
+ArrayModel::headerData(int section, Qt::Orientation orientation, int role) const {
+    if(role != Qt::DisplayRole) return QVariant();
+    if(orientation == Qt::Vertical) return section;
+    return QString("Value");
+}
+
+
+/* Makes sure that the elements from first to last are in our page.  If they
+   are not we get a new handle that covers them, plus a margin, and read it. */
+int
+ArrayModel::setRange(int first, int last) {
+    tag_handle h;
+    std::string name;
+    int result;
+
+    if(_valid && first >= _first && last < _first + (int)_pageh.count) return ERR_OK;
+
+    first = std::max(0, first - ARRAY_PAGE_MARGIN);
+    last = std::min((int)_h.count - 1, last + ARRAY_PAGE_MARGIN);
+    if(last < first) return ERR_ARG;
+
+    name = _tagname + "[" + std::to_string(first) + "]";
+    result = dax->getHandle(&h, (char *)name.c_str(), last - first + 1);
+    if(result) return result;
+    _pageh = h;
+    _first = first;
+    _page.resize(_pageh.size);
+    _prev.resize(_pageh.size);
+    _valid = true;
+    _compare = false;
+    return refresh();
+}
+
+
+/* Sends the page rows that changed.  Neighbours go out as one signal. */
+void
+ArrayModel::_emitRows(const uint32_t *rows, uint32_t count) {
+    uint32_t n, end;
+
+    for(n=0;n<count;n=end) {
+        for(end=n+1;end<count && rows[end] == rows[end - 1] + 1;end++);
+        emit dataChanged(index(_first + rows[n], 0), index(_first + rows[end - 1], 0));
+    }
+}
+
+
+/* BOOL pages are compared with the last read a block at a time so that
+   only the rows that flipped are redrawn.  Other types are only skipped
+   when nothing in the page changed. */
+int
+ArrayModel::refresh(void) {
+    uint32_t count;
+    int result;
+
+    if(!_valid) return ERR_OK;
+    result = dax->read(_pageh, _page.data());
+    if(result) return result;
+    if(!_compare) {
+        emit dataChanged(index(_first, 0), index(_first + _pageh.count - 1, 0));
+    } else if(_h.type == DAX_BOOL) {
+        _flipped.resize(_pageh.count);
+        count = bit_diff(_prev.data(), _page.data(), _pageh.bit, _pageh.count, 0, _flipped.data());
+        _emitRows(_flipped.data(), count);
+    } else if(memcmp(_prev.data(), _page.data(), _pageh.size)) {
+        emit dataChanged(index(_first, 0), index(_first + _pageh.count - 1, 0));
+    }
+    memcpy(_prev.data(), _page.data(), _pageh.size);
+    _compare = true;
+    return ERR_OK;
+}
+
+
+ArrayView::ArrayView(Dax *dax, QString tagname, tag_handle h, int interval, QWidget *parent) : QDialog(parent) {
+    setupUi(this);
+    setWindowTitle(tagname);
+
+    _model = new ArrayModel(dax, tagname, h, this);
+    tableView->setModel(_model);
+    /* Fixed row heights keep the view from measuring every row */
+    tableView->verticalHeader()->setSectionResizeMode(QHeaderView::Fixed);
+    tableView->horizontalHeader()->setStretchLastSection(true);
+    QObject::connect(tableView->verticalScrollBar(), &QScrollBar::valueChanged,
+                     this, &ArrayView::updateRange);
+
+    _timer = new QTimer(this);
+    QObject::connect(_timer, &QTimer::timeout, this, &ArrayView::refresh);
+    _timer->start(interval);
+}
+
+
+ArrayView::~ArrayView() {
+    ;
+}
+
+
+void
+ArrayView::resizeEvent(QResizeEvent *event) {
+    QDialog::resizeEvent(event);
+    updateRange();
+}
+
+
+void
+ArrayView::updateRange(void) {
+    int first, last;
+
+    first = tableView->rowAt(0);
+    last = tableView->rowAt(tableView->viewport()->height() - 1);
+    if(first < 0) first = 0;
+    if(last < 0) last = std::min(first + ARRAY_PAGE_ROWS, _model->rowCount()) - 1;
+    _model->setRange(first, last);
+}
+
+
+void
+ArrayView::refresh(void) {
+    _model->refresh();
+}
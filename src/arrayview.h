@@ -0,0 +1,91 @@
+/*  qDAX - An open source data acquisition and control system
+ *  Copyright (c) 2023 Phil Birkelbach
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+
+ *  Header file for the paged array view dialog
+ */
+
+#ifndef _ARRAY_VIEW_H
+#define _ARRAY_VIEW_H
+
+#include <QAbstractTableModel>
+#include <QTimer>
+#include <vector>
+#include "ui_arrayview.h"
+#include "dax.h"
+
+/* Number of elements that we read on either side of the visible rows so
+   that small scrolls don't need another read */
+#define ARRAY_PAGE_MARGIN 64
+
+/* Rows that we assume are on the screen when the view can't tell us, like
+   before it has been laid out */
+#define ARRAY_PAGE_ROWS 100
+
+/* Table model that only ever holds the part of the array that is on the
+   screen.  The page is read with a handle that covers just those elements. */
+class ArrayModel : public QAbstractTableModel
+{
+    Q_OBJECT
+
+    private:
+        Dax *dax;
+        std::string _tagname;
+        tag_handle _h;     /* The whole array */
+        tag_handle _pageh; /* The part that we have read */
+        int _first;
+        bool _valid;
+        bool _compare;     /* _prev holds the same range as _page */
+        std::vector<uint8_t> _page;
+        std::vector<uint8_t> _prev;
+        std::vector<uint32_t> _flipped;
+
+        void _emitRows(const uint32_t *rows, uint32_t count);
+
+    public:
+        ArrayModel(Dax *dax, QString tagname, tag_handle h, QObject *parent = nullptr);
+
+        int rowCount(const QModelIndex &parent = QModelIndex()) const override;
+        int columnCount(const QModelIndex &parent = QModelIndex()) const override;
+        QVariant data(const QModelIndex &index, int role = Qt::DisplayRole) const override;
+        QVariant headerData(int section, Qt::Orientation orientation, int role = Qt::DisplayRole) const override;
+        int setRange(int first, int last);
+        int refresh(void);
+};
+
+
+class ArrayView : public QDialog, public Ui_ArrayView
+{
+    Q_OBJECT
+
+    private:
+        ArrayModel *_model;
+        QTimer *_timer;
+
+    protected:
+        void resizeEvent(QResizeEvent *event) override;
+
+    public:
+        explicit ArrayView(Dax *dax, QString tagname, tag_handle h, int interval, QWidget *parent = nullptr);
+        ~ArrayView();
+
+    public slots:
+        void updateRange(void);
+        void refresh(void);
+};
+
+#endif
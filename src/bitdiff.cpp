@@ -0,0 +1,107 @@
+/*  qDAX - An open source data acquisition and control system
+ *  Copyright (c) 2023 Phil Birkelbach
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+
+ *  Source code file for the packed bit comparison functions.
+ *
+ *  BOOL arrays are packed eight to a byte.  Instead of testing them one at
+ *  a time we XOR whole blocks of the two copies together and skip the
+ *  blocks that come out zero.  The block test is a branch free loop with
+ *  an OpenMP simd reduction so that it turns into vector instructions.  In
+ *  the blocks that are different the set bits of each 64 bit word are
+ *  found with count trailing zeros, so the work is the number of bits that
+ *  flipped and not the number of bits in the array.
+ */
+
+#include <cstring>
+#include <algorithm>
+#include "bitdiff.h"
+
+/* Writes base plus the index of each set bit in x to out */
+static inline uint32_t
+_emit(uint64_t x, uint32_t base, uint32_t *out) {
+    uint32_t found = 0;
+
+    while(x) {
+        out[found++] = base + __builtin_ctzll(x);
+        x &= x - 1;
+    }
+    return found;
+}
+
+
+/* Bit n of the word has to be bit n % 8 of byte n / 8 */
+static inline uint64_t
+_word(const uint8_t *a, const uint8_t *b) {
+    uint64_t x, y;
+
+    memcpy(&x, a, 8);
+    memcpy(&y, b, 8);
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    return __builtin_bswap64(x ^ y);
+#else
+    return x ^ y;
+#endif
+}
+
+
+/* Finds the bits in [start, start + count) that are different between a
+   and b.  For each one base plus it's index from start is written to out,
+   which has to have room for count entries.  Returns the number found. */
+uint32_t
+bit_diff(const uint8_t *a, const uint8_t *b, uint32_t start, uint32_t count,
+         uint32_t base, uint32_t *out) {
+    const uint8_t *pa, *pb;
+    uint32_t found = 0, head, bytes, rem, n;
+    uint8_t any;
+
+    if(count == 0) return 0;
+    /* The bits in front of the first whole byte */
+    head = std::min((8 - start % 8) % 8, count);
+    if(head) {
+        found += _emit(((a[start / 8] ^ b[start / 8]) >> (start % 8)) & ((1u << head) - 1), base, out);
+        base += head;
+        start += head;
+        count -= head;
+    }
+    pa = &a[start / 8];
+    pb = &b[start / 8];
+    bytes = count / 8;
+    rem = count % 8;
+
+    for(n=0;n + BIT_DIFF_BLOCK <= bytes;n += BIT_DIFF_BLOCK) {
+        any = 0;
+#pragma omp simd reduction(|:any)
+        for(uint32_t i=0;i<BIT_DIFF_BLOCK;i++) {
+            any |= pa[n + i] ^ pb[n + i];
+        }
+        if(any == 0) continue;
+        for(uint32_t i=0;i<BIT_DIFF_BLOCK;i+=8) {
+            found += _emit(_word(&pa[n + i], &pb[n + i]), base + (n + i) * 8, &out[found]);
+        }
+    }
+    for(;n + 8 <= bytes;n += 8) {
+        found += _emit(_word(&pa[n], &pb[n]), base + n * 8, &out[found]);
+    }
+    for(;n<bytes;n++) {
+        found += _emit(pa[n] ^ pb[n], base + n * 8, &out[found]);
+    }
+    if(rem) {
+        found += _emit((pa[bytes] ^ pb[bytes]) & ((1u << rem) - 1), base + bytes * 8, &out[found]);
+    }
+    return found;
+}
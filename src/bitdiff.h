@@ -0,0 +1,33 @@
+/*  qDAX - An open source data acquisition and control system
+ *  Copyright (c) 2023 Phil Birkelbach
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+
+ *  Header file for the packed bit comparison functions
+ */
+
+#ifndef BITDIFF_H
+#define BITDIFF_H
+
+#include <cstdint>
+
+/* Bytes that are compared at once before we look for the bits that changed */
+#define BIT_DIFF_BLOCK 64
+
+uint32_t bit_diff(const uint8_t *a, const uint8_t *b, uint32_t start, uint32_t count,
+                  uint32_t base, uint32_t *out);
+
+#endif
@@ -20,12 +20,15 @@
  */
 
 #include "dax.h"
+#include "trace.h"
 
 
 
 
 /* Dax Class Definitions */
 Dax::Dax(const char *name) {
+    _connected = false;
+    _flags = 0;
     ds = dax_init(name);
     if(ds == NULL) {
         dax_log(DAX_LOG_ERROR, "Unable to Initialize DaxState Object");
@@ -39,10 +42,28 @@ Dax::~Dax() {
 
 int
 Dax::configure(int argc, char **argv, int flags) {
+    /* Kept so that duplicate() can configure another connection the same way */
+    _args.assign(argv, argv + argc);
+    _flags = flags;
     return dax_configure(ds, argc, argv, flags);
 }
 
 
+/* Returns a new unconnected object that is configured like this one.  It's
+   for workers that want a connection of their own. */
+Dax *
+Dax::duplicate(const char *name) {
+    std::vector<char *> argv;
+    Dax *d;
+
+    d = new Dax(name);
+    for(std::string &s : _args) argv.push_back((char *)s.c_str());
+    argv.push_back(nullptr);
+    d->configure(_args.size(), argv.data(), _flags);
+    return d;
+}
+
+
 int
 Dax::connect(void) {
     int result =  dax_connect(ds);
@@ -63,6 +84,7 @@ Dax::connect(void) {
 
 int
 Dax::disconnect(void) {
+    _connected = false;
     return dax_disconnect(ds);
 }
 
@@ -72,6 +94,32 @@ Dax::isConnected(void) {
     return _connected;
 }
 
+
+/* Returns the value of one of the configuration attributes, like "server"
+   or "port", or an empty string if it isn't set */
+std::string
+Dax::getAttr(const char *name) {
+    char *s = dax_get_attr(ds, (char *)name);
+
+    if(s == NULL) return std::string();
+    return std::string(s);
+}
+
+
+/* Returns true if the error returned from one of the other calls indicates
+   that we have lost our connection to the server */
+bool
+Dax::connectionError(int result) {
+    switch(result) {
+        case ERR_DISCONNECTED:
+        case ERR_MSG_SEND:
+        case ERR_MSG_RECV:
+            return true;
+        default:
+            return false;
+    }
+}
+
 int
 Dax::tagAdd(tag_handle *h, std::string name, tag_type type, uint32_t count, uint32_t attr) {
     return dax_tag_add(ds, h, (char *)name.c_str(), type, count, attr);
@@ -95,30 +143,42 @@ Dax::tagDel(std::string name) {
 
 int
 Dax::getTag(dax_tag *tag, char *name) {
-    return dax_tag_byname(ds, tag, name);
+    TraceScope span("getTag");
+    int result = dax_tag_byname(ds, tag, name);
+    if(result == ERR_OK) span.index = tag->idx;
+    return result;
 }
 
 
 int
 Dax::getTag(dax_tag *tag, tag_index index) {
+    TraceScope span("getTag", index);
     return dax_tag_byindex(ds, tag, index);
 }
 
 
 int
 Dax::getHandle(tag_handle *h, char *str, int count) {
-    return dax_tag_handle(ds, h, str, count);
+    TraceScope span("getHandle");
+    int result = dax_tag_handle(ds, h, str, count);
+    if(result == ERR_OK) {
+        span.index = h->index;
+        span.bytes = h->size;
+    }
+    return result;
 }
 
 
 int
 Dax::read(tag_handle h, void *data) {
+    TraceScope span("read", h.index, h.size);
     return dax_tag_read(ds, h, data);
 }
 
 
 int
 Dax::write(tag_handle h, void *data, void *mask) {
+    TraceScope span("write", h.index, h.size);
     if(mask == NULL) {
         return dax_tag_write(ds, h, data);
     } else {
@@ -251,6 +311,7 @@ Dax::_free_callback(void *udata) {
    our callbacks we just call the functions that were stored with the stored data */
 int
 Dax::eventAdd(tag_handle *handle, int event_type, void *data, dax_id *id, void (*callback)(Dax *dax, void *udata), void *udata, void (*free_callback)(void *udata)) {
+    TraceScope span("eventAdd", handle->index, handle->size);
     EventUdata *ud = new EventUdata;
     ud->callback = callback;
     ud->free_callback = free_callback;
@@ -272,6 +333,7 @@ Dax::eventOptions(dax_id id, uint32_t options) {
 
 int
 Dax::eventWait(int timeout, dax_id *id) {
+    TraceScope span("eventWait");
     return dax_event_wait(ds, timeout, id);
 }
 
@@ -284,6 +346,7 @@ Dax::eventPoll(dax_id *id) {
 
 int
 Dax::eventGetData(void *buff, int len) {
+    TraceScope span("eventGetData", -1, len);
     return dax_event_get_data(ds, buff, len);
 }
 
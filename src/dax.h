@@ -38,6 +38,8 @@ class Dax
     private:
         bool _connected;
         dax_state *ds;
+        std::vector<std::string> _args;
+        int _flags;
 
         static void _event_callback(dax_state *ds, void *udata);
         static void _free_callback(void *udata);
@@ -46,9 +48,12 @@ class Dax
         Dax(const char *name);
         ~Dax();
         int configure(int argc, char **argv, int flags);
+        Dax *duplicate(const char *name);
         int connect(void);
         int disconnect(void);
         bool isConnected(void);
+        std::string getAttr(const char *name);
+        static bool connectionError(int result);
         int tagAdd(tag_handle *h, std::string name, tag_type type, uint32_t count, uint32_t attr=0x00);
         int tagDel(tag_index index);
         int tagDel(std::string name);
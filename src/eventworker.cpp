@@ -19,57 +19,109 @@
  *  Source code file for the event worker thread class
  */
 
+#include <algorithm>
 #include "qdax.h"
 #include "eventworker.h"
 
-extern Dax dax;
 
-EventWorker::EventWorker() {
+EventWorker::EventWorker(Dax *dax) {
+    this->dax = dax;
     _quit = false;
+    qRegisterMetaType<QList<TagInfo>>();
+    qRegisterMetaType<QList<tag_index>>();
 }
 
+/* The callbacks only collect the indexes.  go() sends them on in batches
+   so that a module that makes thousands of tags at once doesn't send the
+   GUI thousands of signals. */
 void
 EventWorker::_addTagCallback(Dax *d, void *udata) {
+    EventWorker *w = (EventWorker *)udata;
     tag_index idx;
     int result;
 
-    result = dax.eventGetData(&idx, sizeof(tag_index));
+    result = d->eventGetData(&idx, sizeof(tag_index));
     if(result >= 0) {
-        emit ((EventWorker *)udata)->tagAdded(idx);
+        if(w->_added.isEmpty() && w->_deleted.isEmpty()) w->_batchTime.start();
+        w->_added.append(idx);
     }
 }
 
 
 void
 EventWorker::_delTagCallback(Dax *d, void *udata) {
+    EventWorker *w = (EventWorker *)udata;
     tag_index idx;
     int result;
 
-    result = dax.eventGetData(&idx, sizeof(tag_index));
+    result = d->eventGetData(&idx, sizeof(tag_index));
     if(result >= 0) {
-        emit ((EventWorker *)udata)->tagDeleted(idx);
+        if(w->_added.isEmpty() && w->_deleted.isEmpty()) w->_batchTime.start();
+        w->_deleted.append(idx);
     }
 }
 
 
+/* Gets the definitions and the handles of the new tags here so that the
+   GUI thread isn't waiting on the server.  Deletions go first so that an
+   index that was deleted and used again ends up with the new tag.  A tag
+   that was added and deleted in the same batch fails getTag() and is left
+   out. */
+void
+EventWorker::_flush(void) {
+    QList<TagInfo> tags;
+    TagInfo info;
+
+    if(!_deleted.isEmpty()) {
+        emit tagsDeleted(_deleted);
+        _deleted.clear();
+    }
+    for(tag_index idx : _added) {
+        if(dax->getTag(&info.tag, idx)) continue;
+        if(dax->getHandle(&info.h, info.tag.name)) continue;
+        tags.append(info);
+    }
+    _added.clear();
+    if(!tags.isEmpty()) emit tagsAdded(tags);
+}
+
+
 void
 EventWorker::go(void) {
     tag_handle h;
     dax_id add_id, del_id, id;
+    bool pending;
+    int timeout;
     int result;
 
-    result = dax.getHandle(&h, (char *)"_tag_added");
-    result = dax.eventAdd(&h, EVENT_WRITE, NULL, &add_id, _addTagCallback, this, NULL);
-    result = dax.eventOptions(add_id, EVENT_OPT_SEND_DATA);
-    result = dax.getHandle(&h, (char *)"_tag_deleted");
-    result = dax.eventAdd(&h, EVENT_WRITE, NULL, &del_id, _delTagCallback, this, NULL);
-    result = dax.eventOptions(del_id, EVENT_OPT_SEND_DATA);
+    result = dax->getHandle(&h, (char *)"_tag_added");
+    result = dax->eventAdd(&h, EVENT_WRITE, NULL, &add_id, _addTagCallback, this, NULL);
+    result = dax->eventOptions(add_id, EVENT_OPT_SEND_DATA);
+    result = dax->getHandle(&h, (char *)"_tag_deleted");
+    result = dax->eventAdd(&h, EVENT_WRITE, NULL, &del_id, _delTagCallback, this, NULL);
+    result = dax->eventOptions(del_id, EVENT_OPT_SEND_DATA);
 
     while(!_quit) {
-        result = dax.eventWait(500, &id);
+        timeout = 500;
+        pending = !_added.isEmpty() || !_deleted.isEmpty();
+        if(pending) timeout = std::max<qint64>(1, TAG_BATCH_TIME - _batchTime.elapsed());
+        result = dax->eventWait(timeout, &id);
+        if(Dax::connectionError(result)) {
+            /* The events are gone with the connection so no need to delete them */
+            emit connectionLost();
+            _quit = false;
+            _added.clear();
+            _deleted.clear();
+            return;
+        }
+        if(!_added.isEmpty() || !_deleted.isEmpty()) {
+            if(_batchTime.elapsed() >= TAG_BATCH_TIME || _added.size() + _deleted.size() >= TAG_BATCH_LIMIT) {
+                _flush();
+            }
+        }
     }
-    dax.eventDelete(add_id);
-    dax.eventDelete(del_id);
+    dax->eventDelete(add_id);
+    dax->eventDelete(del_id);
     _quit = false;
 }
 
@@ -23,8 +23,23 @@
 #define EVENTWORKER_H
 
 #include <QObject>
+#include <QList>
+#include <QElapsedTimer>
 #include "dax.h"
 
+/* Tags that are added or deleted within this many milliseconds of the
+   first one are sent to the GUI together */
+#define TAG_BATCH_TIME 50
+/* A batch is sent early if it gets this big */
+#define TAG_BATCH_LIMIT 1000
+
+/* What the worker found out about a new tag so that the GUI doesn't have
+   to ask the server again */
+struct TagInfo {
+    dax_tag tag;
+    tag_handle h;
+};
+
 class EventWorker : public QObject
 {
     Q_OBJECT
@@ -33,9 +48,14 @@ class EventWorker : public QObject
         dax_id _tag_added_event_id;
         dax_id _tag_deleted_event_id;
         bool _quit;
+        Dax *dax;
+        QList<tag_index> _added;
+        QList<tag_index> _deleted;
+        QElapsedTimer _batchTime;
 
         static void _addTagCallback(Dax *dax, void *udata);
         static void _delTagCallback(Dax *dax, void *udata);
+        void _flush(void);
 
     public slots:
         void go(void);
@@ -43,11 +63,12 @@ class EventWorker : public QObject
 
 
     signals:
-        void tagAdded(tag_index tag);
-        void tagDeleted(tag_index tag);
+        void tagsAdded(QList<TagInfo> tags);
+        void tagsDeleted(QList<tag_index> tags);
+        void connectionLost(void);
 
     public:
-        EventWorker();
+        EventWorker(Dax *dax);
 };
 
 #endif
\ No newline at end of file
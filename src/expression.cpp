@@ -0,0 +1,604 @@
+/*  qDAX - An open source data acquisition and control system
+ *  Copyright (c) 2023 Phil Birkelbach
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+
+ *  Source code file for the compiled expressions used by derived watches
+ *
+ *  Expressions are things like "Flow1 + Flow2" or "Tank[3].Level > 80".
+ *  The operators, from lowest to highest precedence, are
+ *
+ *      ||   &&   == !=   < <= > >=   + -   * / %   unary - and !
+ *
+ *  Everything is done in double.  Comparisons and logic give 1 or 0.  An
+ *  expression is parsed once into code for a stack machine with the tag
+ *  references turned into input numbers, so evaluating it is a short loop
+ *  with no lookups.  It is only evaluated when one of it's inputs sends a
+ *  change event, and that happens on the event thread.
+ */
+
+#include <cstring>
+#include <cmath>
+#include <algorithm>
+#include "qdax.h"
+#include "expression.h"
+
+
+template<typename T>
+static double
+_decode(const uint8_t *data, int bit) {
+    T x;
+    memcpy(&x, data, sizeof(T));
+    return (double)x;
+}
+
+
+static double
+_decode_bool(const uint8_t *data, int bit) {
+    return (data[0] >> bit) & 0x01;
+}
+
+
+/* Picks the function that turns the raw data into a double.  Returns
+   nullptr for types that we can't use in an expression. */
+static double (*_decoder(tag_type type))(const uint8_t *, int) {
+    switch(type) {
+        case DAX_BOOL:  return _decode_bool;
+        case DAX_BYTE:  return _decode<uint8_t>;
+        case DAX_SINT:
+        case DAX_CHAR:  return _decode<int8_t>;
+        case DAX_WORD:
+        case DAX_UINT:  return _decode<uint16_t>;
+        case DAX_INT:   return _decode<int16_t>;
+        case DAX_DWORD:
+        case DAX_UDINT: return _decode<uint32_t>;
+        case DAX_DINT:  return _decode<int32_t>;
+        case DAX_LWORD:
+        case DAX_ULINT: return _decode<uint64_t>;
+        case DAX_LINT:
+        case DAX_TIME:  return _decode<int64_t>;
+        case DAX_REAL:  return _decode<float>;
+        case DAX_LREAL: return _decode<double>;
+    }
+    return nullptr;
+}
+
+
+Expression::Expression(QString text) {
+    _text = text;
+    _value = 0.0;
+    callback = nullptr;
+    udata = nullptr;
+}
+
+
+double
+Expression::evaluate(void) {
+    double stack[EXPR_STACK_SIZE];
+    int sp = -1;
+
+    for(const ExprCode &c : _code) {
+        switch(c.op) {
+            case OP_CONST: stack[++sp] = _consts[c.arg]; break;
+            case OP_INPUT: stack[++sp] = _inputs[c.arg]->value; break;
+            case OP_NEG:   stack[sp] = -stack[sp]; break;
+            case OP_NOT:   stack[sp] = stack[sp] == 0.0; break;
+            case OP_ADD:   sp--; stack[sp] = stack[sp] + stack[sp + 1]; break;
+            case OP_SUB:   sp--; stack[sp] = stack[sp] - stack[sp + 1]; break;
+            case OP_MUL:   sp--; stack[sp] = stack[sp] * stack[sp + 1]; break;
+            case OP_DIV:   sp--; stack[sp] = stack[sp] / stack[sp + 1]; break;
+            case OP_MOD:   sp--; stack[sp] = std::fmod(stack[sp], stack[sp + 1]); break;
+            case OP_LT:    sp--; stack[sp] = stack[sp] <  stack[sp + 1]; break;
+            case OP_LE:    sp--; stack[sp] = stack[sp] <= stack[sp + 1]; break;
+            case OP_GT:    sp--; stack[sp] = stack[sp] >  stack[sp + 1]; break;
+            case OP_GE:    sp--; stack[sp] = stack[sp] >= stack[sp + 1]; break;
+            case OP_EQ:    sp--; stack[sp] = stack[sp] == stack[sp + 1]; break;
+            case OP_NE:    sp--; stack[sp] = stack[sp] != stack[sp + 1]; break;
+            case OP_AND:   sp--; stack[sp] = (stack[sp] != 0.0) && (stack[sp + 1] != 0.0); break;
+            case OP_OR:    sp--; stack[sp] = (stack[sp] != 0.0) || (stack[sp + 1] != 0.0); break;
+        }
+    }
+    return stack[0];
+}
+
+
+/* Recursive descent parser that writes the code straight into the
+   expression.  The depth of the stack is tracked as we go so that we know
+   evaluate() can't run off the end of it. */
+class ExprParser
+{
+    private:
+        ExprEngine *_engine;
+        Expression *_e;
+        QString _src;
+        int _pos;
+        int _depth;
+        int _result;
+        QString _error;
+
+        void _skip(void);
+        bool _accept(const char *op);
+        void _emit(uint32_t op, uint32_t arg = 0);
+        void _fail(QString msg);
+        void _or(void);
+        void _and(void);
+        void _equality(void);
+        void _relation(void);
+        void _sum(void);
+        void _product(void);
+        void _unary(void);
+        void _primary(void);
+
+    public:
+        ExprParser(ExprEngine *engine, Expression *e);
+        int parse(QString *error);
+};
+
+
+ExprParser::ExprParser(ExprEngine *engine, Expression *e) {
+    _engine = engine;
+    _e = e;
+    _src = e->text();
+    _pos = 0;
+    _depth = 0;
+    _result = ERR_OK;
+}
+
+
+void
+ExprParser::_skip(void) {
+    while(_pos < _src.size() && _src[_pos].isSpace()) _pos++;
+}
+
+
+bool
+ExprParser::_accept(const char *op) {
+    int len = strlen(op);
+
+    _skip();
+    if(_src.mid(_pos, len) != QLatin1String(op)) return false;
+    /* Don't take the front of a longer operator, < out of <= for example */
+    if(len == 1 && _pos + 1 < _src.size() && _src[_pos + 1] == '=' && strchr("<>=!", op[0])) return false;
+    _pos += len;
+    return true;
+}
+
+
+void
+ExprParser::_fail(QString msg) {
+    if(_result) return;
+    _result = ERR_ARG;
+    _error = msg;
+}
+
+
+/* Adds an instruction.  Operators on constants are worked out right here
+   so "Speed * 60 / 1000" costs the same as "Speed * 0.06". */
+void
+ExprParser::_emit(uint32_t op, uint32_t arg) {
+    std::vector<ExprCode> &code = _e->_code;
+    size_t n = code.size();
+
+    if(op == OP_CONST || op == OP_INPUT) {
+        _depth++;
+        if(_depth > EXPR_STACK_SIZE) _fail("Expression is too deep");
+    } else if(op == OP_NEG || op == OP_NOT) {
+        if(n >= 1 && code[n - 1].op == OP_CONST) {
+            double &x = _e->_consts[code[n - 1].arg];
+            x = (op == OP_NEG) ? -x : (x == 0.0);
+            return;
+        }
+    } else {
+        _depth--;
+        if(n >= 2 && code[n - 1].op == OP_CONST && code[n - 2].op == OP_CONST) {
+            Expression tmp("");
+            tmp._consts = {_e->_consts[code[n - 2].arg], _e->_consts[code[n - 1].arg]};
+            tmp._code = {{OP_CONST, 0}, {OP_CONST, 1}, {op, 0}};
+            _e->_consts[code[n - 2].arg] = tmp.evaluate();
+            code.pop_back();
+            return;
+        }
+    }
+    code.push_back({op, arg});
+}
+
+
+void
+ExprParser::_or(void) {
+    _and();
+    while(!_result && _accept("||")) { _and(); _emit(OP_OR); }
+}
+
+
+void
+ExprParser::_and(void) {
+    _equality();
+    while(!_result && _accept("&&")) { _equality(); _emit(OP_AND); }
+}
+
+
+void
+ExprParser::_equality(void) {
+    _relation();
+    while(!_result) {
+        if(_accept("=="))      { _relation(); _emit(OP_EQ); }
+        else if(_accept("!=")) { _relation(); _emit(OP_NE); }
+        else break;
+    }
+}
+
+
+void
+ExprParser::_relation(void) {
+    _sum();
+    while(!_result) {
+        if(_accept("<="))      { _sum(); _emit(OP_LE); }
+        else if(_accept(">=")) { _sum(); _emit(OP_GE); }
+        else if(_accept("<"))  { _sum(); _emit(OP_LT); }
+        else if(_accept(">"))  { _sum(); _emit(OP_GT); }
+        else break;
+    }
+}
+
+
+void
+ExprParser::_sum(void) {
+    _product();
+    while(!_result) {
+        if(_accept("+"))      { _product(); _emit(OP_ADD); }
+        else if(_accept("-")) { _product(); _emit(OP_SUB); }
+        else break;
+    }
+}
+
+
+void
+ExprParser::_product(void) {
+    _unary();
+    while(!_result) {
+        if(_accept("*"))      { _unary(); _emit(OP_MUL); }
+        else if(_accept("/")) { _unary(); _emit(OP_DIV); }
+        else if(_accept("%")) { _unary(); _emit(OP_MOD); }
+        else break;
+    }
+}
+
+
+void
+ExprParser::_unary(void) {
+    if(_accept("-"))      { _unary(); _emit(OP_NEG); }
+    else if(_accept("!")) { _unary(); _emit(OP_NOT); }
+    else if(_accept("+")) { _unary(); }
+    else                  _primary();
+}
+
+
+/* A number, a tag reference or something in parentheses.  Tag references
+   can have members and subscripts like Tank[3].Level */
+void
+ExprParser::_primary(void) {
+    ExprInput *in;
+    QString name;
+    int start, result;
+    bool ok;
+
+    _skip();
+    if(_pos >= _src.size()) {
+        _fail("Unexpected end of expression");
+        return;
+    }
+    start = _pos;
+    if(_accept("(")) {
+        _or();
+        if(!_result && !_accept(")")) _fail(QString("Missing ')' at %1").arg(_pos + 1));
+        return;
+    }
+    if(_src[_pos].isDigit() || _src[_pos] == '.') {
+        while(_pos < _src.size() && (_src[_pos].isDigit() || _src[_pos] == '.')) _pos++;
+        if(_pos < _src.size() && (_src[_pos] == 'e' || _src[_pos] == 'E')) {
+            _pos++;
+            if(_pos < _src.size() && (_src[_pos] == '-' || _src[_pos] == '+')) _pos++;
+            while(_pos < _src.size() && _src[_pos].isDigit()) _pos++;
+        }
+        double x = _src.mid(start, _pos - start).toDouble(&ok);
+        if(!ok) {
+            _fail(QString("Bad number at %1").arg(start + 1));
+            return;
+        }
+        _e->_consts.push_back(x);
+        _emit(OP_CONST, _e->_consts.size() - 1);
+        return;
+    }
+    if(_src[_pos].isLetter() || _src[_pos] == '_') {
+        while(_pos < _src.size() && (_src[_pos].isLetterOrNumber() || _src[_pos] == '_' ||
+                                     _src[_pos] == '.' || _src[_pos] == '[' || _src[_pos] == ']')) {
+            _pos++;
+        }
+        name = _src.mid(start, _pos - start);
+        in = _engine->_input(name, &result);
+        if(in == nullptr) {
+            _fail(QString("Can't use '%1' - %2").arg(name).arg(dax_errstr(result)));
+            return;
+        }
+        /* The same tag used twice is one input */
+        auto it = std::find(_e->_inputs.begin(), _e->_inputs.end(), in);
+        if(it == _e->_inputs.end()) {
+            _e->_inputs.push_back(in);
+            it = _e->_inputs.end() - 1;
+        }
+        _emit(OP_INPUT, it - _e->_inputs.begin());
+        return;
+    }
+    _fail(QString("Unexpected '%1' at %2").arg(_src[_pos]).arg(_pos + 1));
+}
+
+
+int
+ExprParser::parse(QString *error) {
+    _or();
+    _skip();
+    if(!_result && _pos < _src.size()) {
+        _fail(QString("Unexpected '%1' at %2").arg(_src[_pos]).arg(_pos + 1));
+    }
+    if(_result && error) *error = _error;
+    return _result;
+}
+
+
+ExprEngine::ExprEngine(Dax *dax) {
+    this->dax = dax;
+}
+
+
+ExprEngine::~ExprEngine() {
+    for(ExprInput *in : _inputs) {
+        if(in->subscribed && dax->isConnected()) dax->eventDelete(in->id);
+        delete in;
+    }
+    for(ExprInput *in : _dead) delete in;
+}
+
+
+/* Event callback for an input.  It runs on the event thread. */
+void
+ExprEngine::_input_changed(Dax *d, void *udata) {
+    ExprInput *in = (ExprInput *)udata;
+    uint8_t buff[16];
+
+    if(in->h.size > sizeof(buff)) return;
+    d->eventGetData(buff, in->h.size);
+    std::lock_guard<std::mutex> lock(in->engine->_lock);
+    in->value = in->decode(buff, in->h.bit);
+    for(Expression *e : in->users) {
+        e->_value = e->evaluate();
+        if(e->callback) e->callback(e, e->_value, e->udata);
+    }
+}
+
+
+/* Gets the handle, the first value and the change event for an input.  We
+   don't hold the lock while we talk to the server. */
+int
+ExprEngine::_subscribe(ExprInput *in) {
+    uint8_t buff[16];
+    tag_handle h;
+    int result;
+
+    in->subscribed = false;
+    result = dax->getHandle(&h, (char *)in->name.toStdString().c_str());
+    if(result) return result;
+    if(h.count != 1 || _decoder(h.type) == nullptr || h.size > sizeof(buff)) return ERR_BADTYPE;
+    result = dax->read(h, buff);
+    if(result) return result;
+    in->h = h;
+    in->decode = _decoder(h.type);
+    in->value = in->decode(buff, h.bit);
+
+    result = dax->eventAdd(&in->h, EVENT_CHANGE, NULL, &in->id, _input_changed, in, NULL);
+    if(result) return result;
+    result = dax->eventOptions(in->id, EVENT_OPT_SEND_DATA);
+    if(result) {
+        dax->eventDelete(in->id);
+        return result;
+    }
+    in->subscribed = true;
+    return ERR_OK;
+}
+
+
+/* Returns the input for the named tag.  It's made and subscribed the first
+   time that any expression uses the tag. */
+ExprInput *
+ExprEngine::_input(QString name, int *result) {
+    ExprInput *in;
+
+    {
+        std::lock_guard<std::mutex> lock(_lock);
+        in = _inputs.value(name, nullptr);
+    }
+    if(in) return in;
+
+    in = new ExprInput;
+    in->name = name;
+    in->engine = this;
+    in->value = 0.0;
+    *result = _subscribe(in);
+    if(*result) {
+        delete in;
+        return nullptr;
+    }
+    std::lock_guard<std::mutex> lock(_lock);
+    _inputs.insert(name, in);
+    return in;
+}
+
+
+/* Takes e off of the input's list of users.  Inputs that nobody uses any
+   more are dropped.  The event could already be on it's way to us so the
+   input itself is kept until we disconnect. */
+void
+ExprEngine::_release(ExprInput *in, Expression *e) {
+    bool unused;
+
+    {
+        std::lock_guard<std::mutex> lock(_lock);
+        in->users.erase(std::remove(in->users.begin(), in->users.end(), e), in->users.end());
+        unused = in->users.empty();
+        if(unused) _inputs.remove(in->name);
+    }
+    if(!unused) return;
+    if(in->subscribed) dax->eventDelete(in->id);
+    in->subscribed = false;
+    std::lock_guard<std::mutex> lock(_lock);
+    _dead.push_back(in);
+}
+
+
+/* Compiles e and hooks it up to it's inputs.  On an error the message is
+   put in error. */
+int
+ExprEngine::add(Expression *e, QString *error) {
+    ExprParser parser(this, e);
+    int result;
+
+    result = parser.parse(error);
+    if(result) {
+        for(ExprInput *in : e->_inputs) _release(in, e);
+        e->_inputs.clear();
+        e->_code.clear();
+        return result;
+    }
+    {
+        std::lock_guard<std::mutex> lock(_lock);
+        for(ExprInput *in : e->_inputs) in->users.push_back(e);
+        e->_value = e->evaluate();
+    }
+    if(e->callback) e->callback(e, e->_value, e->udata);
+    return ERR_OK;
+}
+
+
+void
+ExprEngine::remove(Expression *e) {
+    for(ExprInput *in : e->_inputs) _release(in, e);
+    e->_inputs.clear();
+}
+
+
+/* The events went away with the old connection */
+void
+ExprEngine::resubscribe(void) {
+    QList<ExprInput *> inputs;
+    std::vector<Expression *> users;
+
+    {
+        std::lock_guard<std::mutex> lock(_lock);
+        inputs = _inputs.values();
+    }
+    for(ExprInput *in : inputs) {
+        if(_subscribe(in)) {
+            dax_log(DAX_LOG_ERROR, "Unable to resubscribe expression input %s", in->name.toStdString().c_str());
+        }
+    }
+    std::lock_guard<std::mutex> lock(_lock);
+    for(ExprInput *in : inputs) {
+        for(Expression *e : in->users) {
+            if(std::find(users.begin(), users.end(), e) == users.end()) users.push_back(e);
+        }
+    }
+    for(Expression *e : users) {
+        e->_value = e->evaluate();
+        if(e->callback) e->callback(e, e->_value, e->udata);
+    }
+}
+
+
+/* The event thread is stopped so nothing can be using the dead inputs */
+void
+ExprEngine::disconnected(void) {
+    std::lock_guard<std::mutex> lock(_lock);
+    for(ExprInput *in : _inputs) in->subscribed = false;
+    for(ExprInput *in : _dead) delete in;
+    _dead.clear();
+}
+
+
+ExprNotifier::ExprNotifier(QObject *parent) : QObject(parent) {
+    _nextId = 0;
+    QObject::connect(this, &ExprNotifier::changed, this, &ExprNotifier::_show, Qt::QueuedConnection);
+}
+
+
+int
+ExprNotifier::add(ExprItem *item) {
+    _items.insert(_nextId, item);
+    return _nextId++;
+}
+
+
+void
+ExprNotifier::remove(int id) {
+    _items.remove(id);
+}
+
+
+void
+ExprNotifier::_show(int id, double value) {
+    ExprItem *item = _items.value(id, nullptr);
+
+    if(item) item->show(value);
+}
+
+
+/* The item is registered before the first evaluation so that the result
+   of that finds it */
+ExprItem::ExprItem(QTreeWidget *parent, ExprEngine *engine, ExprNotifier *notifier, QString text, QString *error) : QTreeWidgetItem(parent, ITEM_TYPE_EXPR), expr(text) {
+    int result;
+
+    _engine = engine;
+    _notifier = notifier;
+    setData(0, Qt::DisplayRole, text);
+    _id = _notifier->add(this);
+    expr.callback = _show;
+    expr.udata = this;
+    result = _engine->add(&expr, error);
+    if(result) {
+        _notifier->remove(_id);
+        throw result;
+    }
+}
+
+
+ExprItem::~ExprItem() {
+    /* No more callbacks once this returns */
+    _engine->remove(&expr);
+    _notifier->remove(_id);
+}
+
+
+/* Expression callback, usually on the event thread */
+void
+ExprItem::_show(Expression *expr, double value, void *udata) {
+    ExprItem *item = (ExprItem *)udata;
+
+    emit item->_notifier->changed(item->_id, value);
+}
+
+
+void
+ExprItem::show(double value) {
+    setData(1, Qt::DisplayRole, QString::number(value, 'g', 10));
+}
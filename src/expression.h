@@ -0,0 +1,176 @@
+/*  qDAX - An open source data acquisition and control system
+ *  Copyright (c) 2023 Phil Birkelbach
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+
+ *  Header file for the compiled expressions used by derived watches
+ */
+
+#ifndef EXPRESSION_H
+#define EXPRESSION_H
+
+#include <QObject>
+#include <QString>
+#include <QHash>
+#include <QTreeWidget>
+#include <vector>
+#include <mutex>
+#include "dax.h"
+
+#define ITEM_TYPE_EXPR 1003
+
+/* Deepest that the evaluation stack can get */
+#define EXPR_STACK_SIZE 32
+
+enum ExprOp {
+    OP_CONST,
+    OP_INPUT,
+    OP_NEG,
+    OP_NOT,
+    OP_ADD,
+    OP_SUB,
+    OP_MUL,
+    OP_DIV,
+    OP_MOD,
+    OP_LT,
+    OP_LE,
+    OP_GT,
+    OP_GE,
+    OP_EQ,
+    OP_NE,
+    OP_AND,
+    OP_OR
+};
+
+struct ExprCode {
+    uint32_t op;
+    uint32_t arg;   /* Index of the constant or the input */
+};
+
+class Expression;
+class ExprEngine;
+class ExprItem;
+
+/* A tag that one or more expressions read.  Each one has a single change
+   event no matter how many expressions use it.  The decode function is
+   picked for the data type when the handle is resolved. */
+struct ExprInput {
+    QString name;
+    tag_handle h;
+    dax_id id;
+    bool subscribed;
+    double value;
+    double (*decode)(const uint8_t *data, int bit);
+    std::vector<Expression *> users;
+    ExprEngine *engine;
+};
+
+/* An expression is compiled to code for a little stack machine.  The
+   callback is called with the result each time that it's evaluated, which
+   is from the event thread. */
+class Expression
+{
+    friend class ExprEngine;
+    friend class ExprParser;
+
+    private:
+        QString _text;
+        std::vector<ExprCode> _code;
+        std::vector<double> _consts;
+        std::vector<ExprInput *> _inputs;
+        double _value;
+
+    public:
+        void (*callback)(Expression *expr, double value, void *udata);
+        void *udata;
+
+        Expression(QString text);
+        QString text(void) { return _text; };
+        double value(void) { return _value; };
+        double evaluate(void);
+};
+
+/* Owns the inputs and keeps track of which expressions use them.  The
+   lock keeps the GUI thread from changing things while the event thread
+   is evaluating. */
+class ExprEngine
+{
+    friend class ExprParser;
+
+    private:
+        Dax *dax;
+        std::mutex _lock;
+        QHash<QString, ExprInput *> _inputs;
+        std::vector<ExprInput *> _dead;    /* Unused but an event may still be coming */
+
+        static void _input_changed(Dax *d, void *udata);
+        ExprInput *_input(QString name, int *result);
+        int _subscribe(ExprInput *in);
+        void _release(ExprInput *in, Expression *e);
+
+    public:
+        ExprEngine(Dax *dax);
+        ~ExprEngine();
+
+        int add(Expression *e, QString *error);
+        void remove(Expression *e);
+        void resubscribe(void);
+        void disconnected(void);
+};
+
+/* The results for the watchlist come in on the event thread.  They are
+   passed to the GUI thread by a queued signal and the items are looked up
+   by id there, so an item that is deleted in the meantime is just missed. */
+class ExprNotifier : public QObject
+{
+    Q_OBJECT
+
+    private:
+        QHash<int, ExprItem *> _items;
+        int _nextId;
+
+    private slots:
+        void _show(int id, double value);
+
+    signals:
+        void changed(int id, double value);
+
+    public:
+        ExprNotifier(QObject *parent = nullptr);
+
+        int add(ExprItem *item);
+        void remove(int id);
+};
+
+/* An expression in the watchlist */
+class ExprItem : public QTreeWidgetItem
+{
+    private:
+        static void _show(Expression *expr, double value, void *udata);
+        ExprEngine *_engine;
+        ExprNotifier *_notifier;
+        int _id;
+
+    public:
+        Expression expr;
+
+        ExprItem(QTreeWidget *parent, ExprEngine *engine, ExprNotifier *notifier, QString text, QString *error = nullptr);
+        ~ExprItem();
+
+        void show(double value);
+};
+
+#endif
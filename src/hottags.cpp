@@ -0,0 +1,61 @@
+/*  qDAX - An open source data acquisition and control system
+ *  Copyright (c) 2023 Phil Birkelbach
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+
+ *  Source code file for the items in the hot tags panel
+ */
+
+#include <cmath>
+#include "hottags.h"
+
+HotTagItem::HotTagItem(QTreeWidget *parent, QString name, QString source) : QTreeWidgetItem(parent) {
+    _changes = 0;
+    _bytes = 0;
+    _time = 0;
+    setData(HOT_NAME_COLUMN, Qt::DisplayRole, name);
+    setData(HOT_SOURCE_COLUMN, Qt::DisplayRole, source);
+}
+
+
+HotTagItem::HotTagItem(QTreeWidgetItem *parent, QString name, QString source) : QTreeWidgetItem(parent) {
+    _changes = 0;
+    _bytes = 0;
+    _time = 0;
+    setData(HOT_NAME_COLUMN, Qt::DisplayRole, name);
+    setData(HOT_SOURCE_COLUMN, Qt::DisplayRole, source);
+}
+
+
+/* Takes the running totals from the tag and shows the rates since the last
+   time that we were called.  The first call only records the totals. */
+void
+HotTagItem::update(uint64_t changes, uint64_t bytes, qint64 lastChange, qint64 now) {
+    double rate;
+
+    if(_time != 0 && now > _time) {
+        rate = (changes - _changes) * 1000.0 / (now - _time);
+        setData(HOT_CHANGES_COLUMN, Qt::DisplayRole, std::round(rate * 10.0) / 10.0);
+        rate = (bytes - _bytes) * 1000.0 / (now - _time);
+        setData(HOT_BYTES_COLUMN, Qt::DisplayRole, std::round(rate * 10.0) / 10.0);
+    }
+    if(lastChange != 0) {
+        setData(HOT_LAST_COLUMN, Qt::DisplayRole, QDateTime::fromMSecsSinceEpoch(lastChange).time());
+    }
+    _changes = changes;
+    _bytes = bytes;
+    _time = now;
+}
@@ -0,0 +1,54 @@
+/*  qDAX - An open source data acquisition and control system
+ *  Copyright (c) 2023 Phil Birkelbach
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+
+ *  Header file for the items in the hot tags panel
+ */
+
+#ifndef HOTTAGS_H
+#define HOTTAGS_H
+
+#include <QTreeWidget>
+#include <QDateTime>
+
+#define HOT_NAME_COLUMN 0
+#define HOT_SOURCE_COLUMN 1
+#define HOT_CHANGES_COLUMN 2
+#define HOT_BYTES_COLUMN 3
+#define HOT_LAST_COLUMN 4
+
+/* Rates are figured over this many milliseconds */
+#define HOT_UPDATE_TIME 1000
+
+/* One row in the hot tags panel.  The item remembers the counters from the
+   last update so that it can turn them into rates.  The rates are stored
+   as numbers so that the tree sorts them as numbers. */
+class HotTagItem : public QTreeWidgetItem
+{
+    private:
+        uint64_t _changes;
+        uint64_t _bytes;
+        qint64 _time;
+
+    public:
+        HotTagItem(QTreeWidget *parent, QString name, QString source);
+        HotTagItem(QTreeWidgetItem *parent, QString name, QString source);
+
+        void update(uint64_t changes, uint64_t bytes, qint64 lastChange, qint64 now);
+};
+
+#endif
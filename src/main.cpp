@@ -21,22 +21,63 @@
 
 #include <QApplication>
 #include <QPushButton>
+#include <cstring>
 #include "mainwindow.h"
+#include "monitor.h"
 #include "dax.h"
 
-Dax dax("qdax");
+/* Runs qdax without any GUI.  Everything in front of --monitor is passed
+   to the library configuration and everything after it is ours.
+
+   qdax [options] --monitor [--binary] tagname|pattern ... */
+static int
+run_monitor(int argc, char *argv[], int mon_arg)
+{
+    bool binary = false;
+    int result;
+    Dax dax("qdax");
+
+    for(int n = mon_arg + 1; n < argc; n++) {
+        if(strcmp(argv[n], "--binary") == 0) binary = true;
+    }
+    dax.configure(mon_arg, argv, CFG_CMDLINE);
+    if(dax.connect() != ERR_OK) {
+        return 1;
+    }
+    Monitor monitor(&dax, binary);
+    for(int n = mon_arg + 1; n < argc; n++) {
+        if(strcmp(argv[n], "--binary") == 0) continue;
+        result = monitor.addPattern(argv[n]);
+        if(result) {
+            dax_log(DAX_LOG_ERROR, "Unable to monitor %s - %s", argv[n], dax_errstr(result));
+        }
+    }
+    return monitor.run();
+}
+
 
 int
 main(int argc, char *argv[])
 {
-    dax_state *ds;
+    Dax *dax;
     int retval;
 
+    for(int n = 1; n < argc; n++) {
+        if(strcmp(argv[n], "--monitor") == 0) {
+            return run_monitor(argc, argv, n);
+        }
+    }
+
     QApplication app(argc, argv);
+    /* These decide where QSettings and the tag cache are kept */
+    QCoreApplication::setOrganizationName("OpenDAX");
+    QCoreApplication::setApplicationName("qdax");
 
-    dax.configure(argc, argv, CFG_CMDLINE);
+    /* The main window owns this and deletes it when it goes away */
+    dax = new Dax("qdax");
+    dax->configure(argc, argv, CFG_CMDLINE);
 
-    MainWindow mainwindow;
+    MainWindow mainwindow(dax);
 
     mainwindow.show();
 
@@ -20,28 +20,57 @@
  */
 
 #include <iostream>
+#include <cstring>
+#include <algorithm>
 #include "qdax.h"
 #include "mainwindow.h"
 #include "dax.h"
 #include <QMessageBox>
+#include <QInputDialog>
+#include <QProcess>
+#include <QDateTime>
+#include <QElapsedTimer>
+#include <QSettings>
+#include <QFileDialog>
+#include <QFileInfo>
+#include <QGuiApplication>
 
-extern Dax dax;
 
-MainWindow::MainWindow(QWidget *parent) : QMainWindow(parent) {
+MainWindow::MainWindow(Dax *dax, QWidget *parent) : QMainWindow(parent) {
+    this->dax = dax;
+    /* The tag tree and the watches keep the last data next to the current
+       data so they get a second plane.  The tag tree has a third plane for
+       the values that were there when it was frozen. */
+    _tagArena = new TagArena(3);
+    _watchArena = new TagArena(2);
     setupUi(this);
     /* GUI Setup */
     _aboutDialog = new AboutDialog(this);
     QObject::connect(action_About, &QAction::triggered, _aboutDialog, &QDialog::open);
-    treeWidget->setColumnCount(3);
-    treeWidget->header()->resizeSection(0,200); // Something to save in QSettings
-    treeWidget->setHeaderLabels(QStringList({"Tagname", "Type", "Value"}));
-    treeWidget->setContextMenuPolicy(Qt::CustomContextMenu);
-    QObject::connect(treeWidget, &QTreeWidget::customContextMenuRequested,
+    QObject::connect(actionNew_Connection, &QAction::triggered, this, &MainWindow::newConnection);
+    _tagModel = new TagModel(dax, _tagArena, this);
+    _tagCache = new TagCache(dax);
+    _serverState = {0, -1, -1};
+    _tagSort = new TagSortModel(this);
+    _tagSort->setSourceModel(_tagModel);
+    treeView->setModel(_tagSort);
+    _valueCache = new ValueCache;
+    _scheduler = new TagScheduler(dax, _tagModel, _valueCache);
+    _tagModel->setStaleTime(spinBoxInterval->value());
+    /* Start out in the order that the server gives us the tags */
+    treeView->header()->setSortIndicator(-1, Qt::AscendingOrder);
+    treeView->header()->setSortIndicatorClearable(true);
+    treeView->setSortingEnabled(true);
+    treeView->header()->resizeSection(0,200); // Something to save in QSettings
+    treeView->setContextMenuPolicy(Qt::CustomContextMenu);
+    QObject::connect(treeView, &QTreeView::customContextMenuRequested,
                      this, &MainWindow::treeContextMenu);
-    QObject::connect(treeWidget, &QTreeWidget::itemActivated,
+    QObject::connect(treeView, &QTreeView::activated,
                      this, &MainWindow::treeItemActivate);
-    QObject::connect(treeWidget, &QTreeWidget::currentItemChanged,
+    QObject::connect(treeView->selectionModel(), &QItemSelectionModel::currentChanged,
                     this, &MainWindow::treeItemChanged);
+    QObject::connect(treeView, &QTreeView::expanded, this, &MainWindow::treeExpanded);
+    QObject::connect(treeView, &QTreeView::collapsed, this, &MainWindow::treeCollapsed);
     lineEditTree->setVisible(false);
     QObject::connect(lineEditTree, &QLineEdit::returnPressed, this, &MainWindow::editAccept);
     toolButtonAccept->setVisible(false);
@@ -51,16 +80,43 @@ MainWindow::MainWindow(QWidget *parent) : QMainWindow(parent) {
     QObject::connect(actionDelete_Tag, &QAction::triggered, this, &MainWindow::deleteTag);
     QObject::connect(actionAdd_Type, &QAction::triggered, this, &MainWindow::addType);
     QObject::connect(actionAdd_To_Watchlist, &QAction::triggered, this, &MainWindow::addToWatchlist);
+    QObject::connect(actionArray_View, &QAction::triggered, this, &MainWindow::arrayView);
     /* Tag Update Timer Object */
     tagTimer = new QTimer(this);
-    QObject::connect(tagTimer, &QTimer::timeout, this, &MainWindow::updateTags);
+    QObject::connect(tagTimer, &QTimer::timeout, this, &MainWindow::pollTags);
+    /* Reconnect timer is single shot so that we can back off between attempts */
+    eventThread = nullptr;
+    eventworker = nullptr;
+    _resumeUpdate = false;
+    _reconnectDelay = RECONNECT_MIN_DELAY;
+    reconnectTimer = new QTimer(this);
+    reconnectTimer->setSingleShot(true);
+    QObject::connect(reconnectTimer, &QTimer::timeout, this, &MainWindow::reconnect);
+
+    treeWidgetHot->setColumnCount(5);
+    treeWidgetHot->header()->resizeSection(HOT_NAME_COLUMN, 200);
+    treeWidgetHot->setHeaderLabels(QStringList({"Tagname", "Source", "Changes/s", "Bytes/s", "Last Change"}));
+    treeWidgetHot->setSortingEnabled(true);
+    treeWidgetHot->sortByColumn(HOT_CHANGES_COLUMN, Qt::DescendingOrder);
+    hotTimer = new QTimer(this);
+    QObject::connect(hotTimer, &QTimer::timeout, this, &MainWindow::updateHotTags);
+    hotTimer->start(HOT_UPDATE_TIME);
     /* Set Tag Tree update buttons */
     toolButtonPlay->setDefaultAction(actionStart_Update);
     toolButtonStop->setDefaultAction(actionStop_Update);
     toolButtonRefresh->setDefaultAction(actionTag_Refresh);
+    toolButtonFreeze->setDefaultAction(actionFreeze);
+    toolButtonAdaptive->setDefaultAction(actionAdaptive_Polling);
     QObject::connect(actionStart_Update, &QAction::triggered, this, &MainWindow::startTagUpdate);
     QObject::connect(actionStop_Update, &QAction::triggered, this, &MainWindow::stopTagUpdate);
     QObject::connect(actionTag_Refresh, &QAction::triggered, this, &MainWindow::updateTags);
+    QObject::connect(actionFreeze, &QAction::toggled, this, &MainWindow::freezeTags);
+    QObject::connect(actionAdaptive_Polling, &QAction::toggled, this, &MainWindow::adaptivePolling);
+    _pollSkipped = 0;
+    _pollWindow.start();
+    _pollThread = nullptr;
+    _pollWorker = nullptr;
+    _polling = false;
 
     treeWidgetWatch->setColumnCount(2);
     treeWidgetWatch->header()->resizeSection(0,200); // Something to save in QSettings
@@ -69,6 +125,33 @@ MainWindow::MainWindow(QWidget *parent) : QMainWindow(parent) {
     QObject::connect(treeWidgetWatch, &QTreeWidget::customContextMenuRequested,
                      this, &MainWindow::treeWatchContextMenu);
     QObject::connect(actionDelete_From_Watchlist, &QAction::triggered, this, &MainWindow::delFromWatchlist);
+    QObject::connect(actionSave_Watchlist, &QAction::triggered, this, &MainWindow::saveWatchlist);
+    QObject::connect(actionLoad_Watchlist, &QAction::triggered, this, &MainWindow::loadWatchlist);
+    QObject::connect(actionAdd_Expression, &QAction::triggered, this, &MainWindow::addExpression);
+    QObject::connect(actionWatch_Filter, &QAction::triggered, this, &MainWindow::watchFilter);
+    QObject::connect(actionRecord_Trace, &QAction::toggled, this, &MainWindow::recordTrace);
+    _loaderThread = nullptr;
+    _loader = nullptr;
+    _exprEngine = new ExprEngine(dax);
+    _exprNotifier = new ExprNotifier(this);
+    _watchNotifier = new WatchNotifier(this);
+
+    _alarmEngine = new AlarmEngine(_exprEngine);
+    QObject::connect(_alarmEngine, &AlarmEngine::changed, this, &MainWindow::alarmChanged);
+    treeWidgetAlarms->setColumnCount(5);
+    treeWidgetAlarms->header()->resizeSection(ALARM_NAME_COLUMN, 200);
+    treeWidgetAlarms->setHeaderLabels(QStringList({"Alarm", "Condition", "State", "Value", "Since"}));
+    treeWidgetAlarms->setSortingEnabled(true);
+    treeWidgetAlarms->sortByColumn(ALARM_TIME_COLUMN, Qt::DescendingOrder);
+    treeWidgetAlarms->setContextMenuPolicy(Qt::CustomContextMenu);
+    QObject::connect(treeWidgetAlarms, &QTreeWidget::customContextMenuRequested,
+                     this, &MainWindow::treeAlarmContextMenu);
+    QObject::connect(actionAdd_Alarm, &QAction::triggered, this, &MainWindow::addAlarm);
+    QObject::connect(actionDelete_Alarm, &QAction::triggered, this, &MainWindow::deleteAlarm);
+    QObject::connect(actionCapture_Snapshot, &QAction::triggered, this, &MainWindow::captureSnapshot);
+    QObject::connect(actionOpen_Snapshot, &QAction::triggered, this, &MainWindow::openSnapshot);
+    QObject::connect(actionCompare_Snapshots, &QAction::triggered, this, &MainWindow::compareSnapshots);
+    QObject::connect(actionCompare_Live, &QAction::triggered, this, &MainWindow::compareLive);
 
     actionStart_Update->setEnabled(false);
     actionStop_Update->setEnabled(false);
@@ -80,98 +163,462 @@ MainWindow::MainWindow(QWidget *parent) : QMainWindow(parent) {
 }
 
 MainWindow::~MainWindow() {
+    stopLoader();
+    if(!_watchlistName.isEmpty()) storeWatchlist(_watchlistName);
     disconnect();
+    /* The items have to give their buffers back before the arenas go away */
+    treeWidgetWatch->clear();
+    treeWidgetAlarms->clear();
+    delete _alarmEngine;
+    delete _exprEngine;
+    delete _tagSort;
+    delete _scheduler;
+    delete _tagModel;
+    delete _valueCache;
+    delete _tagCache;
+    delete _tagArena;
+    delete _watchArena;
+    delete dax;
+}
+
+
+/* Opens another window with it's own connection.  Each window owns a
+   separate Dax object and event thread so that servers don't block each
+   other.  The options are given the same way as on the command line. */
+void
+MainWindow::newConnection(void) {
+    std::vector<std::string> args;
+    std::vector<char *> argv;
+    MainWindow *window;
+    Dax *newdax;
+    bool ok;
 
+    QString options = QInputDialog::getText(this, "New Connection", "Server Options:",
+                                            QLineEdit::Normal, QString(), &ok);
+    if(!ok) return;
+
+    args.push_back("qdax");
+    for(QString arg : QProcess::splitCommand(options)) {
+        args.push_back(arg.toStdString());
+    }
+    for(std::string &arg : args) {
+        argv.push_back((char *)arg.c_str());
+    }
+    argv.push_back(NULL);
+
+    newdax = new Dax("qdax");
+    newdax->configure(args.size(), argv.data(), CFG_CMDLINE);
+    window = new MainWindow(newdax);
+    window->setAttribute(Qt::WA_DeleteOnClose);
+    if(!options.isEmpty()) {
+        window->setWindowTitle(windowTitle() + " - " + options);
+    }
+    window->show();
 }
 
 
 void
 MainWindow::connect(void) {
-    tag_index lastindex;
-    tag_handle h;
     int result;
 
-    if( dax.connect() == ERR_OK ) {
+    if( dax->connect() == ERR_OK ) {
         dax_log(DAX_LOG_DEBUG, "Connected");
         actionDisconnect->setDisabled(false);
         actionConnect->setDisabled(true);
-        result = dax.getHandle(&h, (char *)"_lastindex");
-        // TODO deal with error here
-        result = dax.read(h, &lastindex);
-        // TODO deal with error here
-        for(tag_index n = 0; n<=lastindex; n++) {
-            addTagToTree(n);
+        result = loadTags();
+        if(result) {
+            disconnect();
+            statusbar->showMessage(QString("Unable to get the tag list - ") + dax_errstr(result));
+            return;
         }
         updateTags();
-        eventThread = new QThread();
-        eventworker = new EventWorker();
-        eventworker->moveToThread(eventThread);
-        QObject::connect(this, &MainWindow::operate, eventworker, &EventWorker::go);
-        QObject::connect(eventworker, &EventWorker::tagAdded, this, &MainWindow::addTagToTree);
-        QObject::connect(eventworker, &EventWorker::tagDeleted, this, &MainWindow::delTagFromTree);
-        eventThread->start();
-        emit operate();
+        /* Anything left from before a disconnect needs it's events back,
+           the same as after a reconnect */
+        resubscribeWatches();
+        _exprEngine->resubscribe();
+        startEventThread();
+        startPollThread();
+        if(treeWidgetWatch->topLevelItemCount() == 0) {
+            QSettings settings;
+            restoreWatchlist(settings.value("watchlist/current/" + _tagCache->id(), "Default").toString());
+        }
+        if(_alarmItems.isEmpty()) restoreAlarms();
         actionStart_Update->setEnabled(true);
         actionTag_Refresh->setEnabled(true);
-        statusbar->showMessage("Connected");
+        statusbar->showMessage("Connected - " + arenaReport());
     } else {
         statusbar->showMessage("Failed to Connect");
     }
 }
 
 
+/* Fills the tag tree.  If the cache file belongs to this run of the server
+   we start from that and only ask about the tags that were added after it
+   was written.  Without the server's last index there's no way to list
+   the tags at all so that is returned as an error. */
+int
+MainWindow::loadTags(void) {
+    tag_index first = 0;
+    tag_index cached;
+    int result;
+
+    result = _tagCache->serverState(&_serverState);
+    if(result) {
+        dax_log(DAX_LOG_ERROR, "Unable to get the server state - %s", dax_errstr(result));
+        return result;
+    }
+    if(_tagCache->load(_tagModel, &_serverState, &cached) == ERR_OK) {
+        dax_log(DAX_LOG_DEBUG, "Loaded %d tags from the cache", _tagModel->rootCount());
+        first = cached + 1;
+    }
+    for(tag_index n = first; n<=_serverState.lastindex; n++) {
+        addTagToTree(n);
+    }
+    /* Some tags were deleted since the cache was written */
+    if(first && _serverState.tagcount >= 0 && _tagModel->rootCount() != _serverState.tagcount) {
+        dax_log(DAX_LOG_DEBUG, "Tag cache is stale");
+        _tagModel->clear();
+        _scheduler->clear();
+        for(tag_index n = 0; n<=_serverState.lastindex; n++) {
+            addTagToTree(n);
+        }
+    }
+    _tagCache->save(_tagModel, &_serverState);
+    return ERR_OK;
+}
+
+
+/* Writes the tag cache with the latest state of the server */
+void
+MainWindow::saveTags(void) {
+    if(!dax->isConnected()) return;
+    if(_tagCache->serverState(&_serverState) != ERR_OK) return;
+    _tagCache->save(_tagModel, &_serverState);
+}
+
+
 void
 MainWindow::disconnect(void) {
     actionConnect->setDisabled(false);
     actionDisconnect->setDisabled(true);
+    reconnectTimer->stop();
+    stopLoader();
+    stopEventThread();
+    stopPollThread();
+    _exprEngine->disconnected();
+    saveTags();
+    dax->disconnect();
+    dax_log(DAX_LOG_DEBUG, "Disconnected");
+    statusbar->showMessage("Disconnected");
+    actionFreeze->setChecked(false);
+    _tagModel->clear();
+    _scheduler->clear();
+    _valueCache->clear();
+    _tagArena->clear();
+    treeWidgetHot->clear();
+    _hotItems.clear();
+    treeView->setEnabled(true);
+    stopTagUpdate();
+    actionStart_Update->setEnabled(false);
+    actionStop_Update->setEnabled(false);
+    actionTag_Refresh->setEnabled(false);
+}
+
+
+/* There is only ever one worker per connection so any old one is stopped
+   before it is replaced */
+void
+MainWindow::startEventThread(void) {
+    stopEventThread();
+    eventThread = new QThread();
+    eventworker = new EventWorker(dax);
+    eventworker->moveToThread(eventThread);
+    QObject::connect(this, &MainWindow::operate, eventworker, &EventWorker::go);
+    QObject::connect(eventworker, &EventWorker::tagsAdded, this, &MainWindow::tagsAdded);
+    QObject::connect(eventworker, &EventWorker::tagsDeleted, this, &MainWindow::tagsDeleted);
+    QObject::connect(eventworker, &EventWorker::connectionLost, this, &MainWindow::connectionLost);
+    eventThread->start();
+    emit operate();
+}
+
+
+void
+MainWindow::stopEventThread(void) {
+    if(eventThread == nullptr) return;
     eventworker->quit();
     eventThread->quit();
     eventThread->wait(2000);
     delete eventThread;
     delete eventworker;
-    dax.disconnect();
-    dax_log(DAX_LOG_DEBUG, "Disconnected");
-    statusbar->showMessage("Disconnected");
-    treeWidget->clear();
-    stopTagUpdate();
+    eventThread = nullptr;
+    eventworker = nullptr;
+}
+
+
+/* The tag timer's reads are done on a thread of their own so that a slow
+   server doesn't hold up the GUI */
+void
+MainWindow::startPollThread(void) {
+    stopPollThread();
+    _pollThread = new QThread();
+    _pollWorker = new PollWorker(dax);
+    _pollWorker->moveToThread(_pollThread);
+    QObject::connect(_pollWorker, &PollWorker::done, this, &MainWindow::pollDone);
+    _pollThread->start();
+}
+
+
+/* A plan that's being read is let finish.  Its done() may still be in the
+   queue so _polling is what tells pollDone() to ignore it. */
+void
+MainWindow::stopPollThread(void) {
+    _polling = false;
+    if(_pollThread == nullptr) return;
+    _pollThread->quit();
+    _pollThread->wait();
+    delete _pollThread;
+    delete _pollWorker;
+    _pollThread = nullptr;
+    _pollWorker = nullptr;
+}
+
+
+/* Called when either the event worker or a tag read discovers that the
+   server has gone away.  We keep the tree and the watchlist intact so that
+   we can put them back together when the server returns. */
+void
+MainWindow::connectionLost(void) {
+    if(!dax->isConnected()) return;
+
+    _resumeUpdate = tagTimer->isActive();
+    tagTimer->stop();
+    stopLoader();
+    stopEventThread();
+    stopPollThread();
+    _exprEngine->disconnected();
+    dax->disconnect();
+    _valueCache->clear();
+    dax_log(DAX_LOG_ERROR, "Lost connection to the tag server");
+    treeView->setEnabled(false);
     actionStart_Update->setEnabled(false);
     actionStop_Update->setEnabled(false);
     actionTag_Refresh->setEnabled(false);
+    actionAdd_To_Watchlist->setEnabled(false);
+    _reconnectDelay = RECONNECT_MIN_DELAY;
+    statusbar->showMessage(QString("Connection lost - reconnecting in %1 s").arg(_reconnectDelay / 1000));
+    reconnectTimer->start(_reconnectDelay);
+}
+
+
+/* Reconnect timer slot.  Each failure doubles the delay up to the maximum */
+void
+MainWindow::reconnect(void) {
+    bool resume = _resumeUpdate;
+
+    if(dax->connect() != ERR_OK) {
+        _reconnectDelay *= 2;
+        if(_reconnectDelay > RECONNECT_MAX_DELAY) _reconnectDelay = RECONNECT_MAX_DELAY;
+        statusbar->showMessage(QString("Reconnect failed - retrying in %1 s").arg(_reconnectDelay / 1000));
+        reconnectTimer->start(_reconnectDelay);
+        return;
+    }
+    dax_log(DAX_LOG_DEBUG, "Reconnected");
+    resyncTags();
+    /* A failed read in there means the server went away again.
+       connectionLost() has already set the timer for the next try. */
+    if(!dax->isConnected()) {
+        _resumeUpdate = resume;
+        return;
+    }
+    resubscribeWatches();
+    _exprEngine->resubscribe();
+    startEventThread();
+    startPollThread();
+    treeView->setEnabled(true);
+    actionTag_Refresh->setEnabled(true);
+    if(_resumeUpdate) {
+        startTagUpdate();
+    } else {
+        stopTagUpdate();
+    }
+    statusbar->showMessage("Reconnected - " + arenaReport());
+}
+
+
+/* Compare the server's tag database against what we have in the tree and
+   only touch the items that differ.  Tags are matched by index and we
+   consider them the same if the name, type and size still agree. */
+void
+MainWindow::resyncTags(void) {
+    QHash<tag_index, RootTag *> stale;
+    ServerState st;
+    RootTag *r;
+    dax_tag tag;
+    int result, stateResult;
+
+    /* Without the server's state we can't tell what was deleted so we leave
+       the tree alone.  If the connection went away again connectionLost()
+       starts the next try. */
+    stateResult = _tagCache->serverState(&st);
+    if(stateResult) {
+        dax_log(DAX_LOG_ERROR, "Unable to get the server state - %s", dax_errstr(stateResult));
+        if(Dax::connectionError(stateResult)) connectionLost();
+        return;
+    }
+    /* If it's the same run of the server and nothing has been added or
+       deleted then all of our handles are still good */
+    if(st.starttime != 0 && st.starttime == _serverState.starttime &&
+       st.lastindex == _serverState.lastindex && st.tagcount == _serverState.tagcount) {
+        updateTags();
+        return;
+    }
+
+    for(int n=0; n < _tagModel->rootCount(); n++) {
+        r = _tagModel->root(n);
+        stale.insert(r->idx, r);
+    }
+    _tagModel->forgetTypes();
+
+    for(tag_index n = 0; n<=st.lastindex; n++) {
+        result = dax->getTag(&tag, n);
+        if(Dax::connectionError(result)) {
+            connectionLost();
+            return;
+        }
+        /* Only a tag that the server says isn't there is deleted.  Any
+           other error and we keep what we have. */
+        if(result == ERR_NOTFOUND || result == ERR_DELETED) continue;
+        if(result != ERR_OK) {
+            stale.remove(n);
+            continue;
+        }
+        r = stale.take(n);
+        if(r != nullptr) {
+            if(_tagModel->matches(r, tag) && _tagModel->rebind(r, tag)) continue;
+            delTagFromTree(n);
+        }
+        addTagToTree(n);
+    }
+    /* Whatever is left over no longer exists on the server */
+    for(tag_index idx : stale.keys()) {
+        delTagFromTree(idx);
+    }
+    _serverState = st;
+    updateTags();
+}
+
+
+/* Returns the model index of the item that is selected in the tag tree */
+QModelIndex
+MainWindow::currentTag(void) {
+    return _tagSort->mapToSource(treeView->currentIndex());
+}
+
+
+/* Describes how much memory the tag buffers are using and how much of the
+   arena is wasted in freed buffers and partly used chunks */
+QString
+MainWindow::arenaReport(void) {
+    ArenaStats st = _tagArena->stats();
+    double unused = 0.0;
+
+    if(st.reserved) unused = 100.0 * (st.reserved - st.live) / st.reserved;
+    return QString("%1 tags, %2 nodes, %3 kB of tag buffers in %4 chunks, %5% unused")
+                   .arg(_tagModel->rootCount()).arg(_tagModel->nodes())
+                   .arg(st.live / 1024).arg(st.chunks).arg(unused, 0, 'f', 1);
+}
+
+
+void
+MainWindow::resubscribeWatches(void) {
+    WatchItem *item;
+
+    for(int n=0; n < treeWidgetWatch->topLevelItemCount(); n++) {
+        if(treeWidgetWatch->topLevelItem(n)->type() == ITEM_TYPE_EXPR) continue;
+        item = (WatchItem *)treeWidgetWatch->topLevelItem(n);
+        item->resubscribe();
+    }
 }
 
 
 void
 MainWindow::addTagToTree(tag_index idx) {
-    TagRootItem *item;
     int result;
     dax_tag tag;
 
-    result = dax.getTag(&tag, idx);
+    result = dax->getTag(&tag, idx);
     if(result == ERR_OK) {
-        item = new TagRootItem(static_cast<QTreeWidget *>(nullptr), tag);
-        treeWidget->addTopLevelItem(item);
+        _tagModel->addTag(tag);
+        /* Keep track of new tags so that a reconnect can tell if anything
+           changed while we were gone */
+        if(idx > _serverState.lastindex) {
+            _serverState.lastindex = idx;
+            if(_serverState.tagcount >= 0) _serverState.tagcount++;
+        }
+    }
+}
+
+
+/* Drops what the value cache and the watches know about a deleted tag so
+   that a new tag that gets the same index starts clean */
+void
+MainWindow::forgetTag(tag_index idx) {
+    WatchItem *item;
+
+    _valueCache->remove(idx);
+    if(_loader) return; /* The loader has the items */
+    for(int n=0; n < treeWidgetWatch->topLevelItemCount(); n++) {
+        if(treeWidgetWatch->topLevelItem(n)->type() == ITEM_TYPE_EXPR) continue;
+        item = (WatchItem *)treeWidgetWatch->topLevelItem(n);
+        if(item->handle().index == idx) item->tagDeleted();
     }
 }
 
 
 void
 MainWindow::delTagFromTree(tag_index idx) {
-    TagRootItem *item;
-    int n;
-
-    for(n=0; n < treeWidget->topLevelItemCount(); n++) {
-        item = (TagRootItem *)treeWidget->topLevelItem(n);
-        if(item->handle().index == idx) {
-            /* Reading from the deleted tag should clear it from the cache */
-            dax.read(item->handle(), item->getData());
-            /* This removes it */
-            treeWidget->takeTopLevelItem(n);
-            delete item;
-            return;
+    RootTag *r;
+
+    r = _tagModel->rootTag(idx);
+    if(r == nullptr) return;
+    /* Reading from the deleted tag should clear it from the cache */
+    if(dax->isConnected() && !r->paged) dax->read(r->h, r->data);
+    removeHotItem(_tagModel->nodeName(_tagModel->rootIndex(r)), "Poll");
+    forgetTag(idx);
+    _tagModel->removeTag(idx);
+    if(_serverState.tagcount > 0) _serverState.tagcount--;
+}
+
+
+/* The event worker has already fetched the tags and their handles so
+   these go straight into the model */
+void
+MainWindow::tagsAdded(QList<TagInfo> tags) {
+    _tagModel->addTags(tags);
+    for(const TagInfo &t : tags) {
+        if(t.tag.idx > _serverState.lastindex) {
+            _serverState.lastindex = t.tag.idx;
+            if(_serverState.tagcount >= 0) _serverState.tagcount++;
         }
     }
 }
 
+
+void
+MainWindow::tagsDeleted(QList<tag_index> tags) {
+    RootTag *r;
+
+    for(tag_index idx : tags) {
+        r = _tagModel->rootTag(idx);
+        if(r == nullptr) continue;
+        if(dax->isConnected() && !r->paged) dax->read(r->h, r->data);
+        removeHotItem(_tagModel->nodeName(_tagModel->rootIndex(r)), "Poll");
+        forgetTag(idx);
+        if(_serverState.tagcount > 0) _serverState.tagcount--;
+    }
+    _tagModel->removeTags(tags);
+}
+
 void
 MainWindow::startTagUpdate(void) {
     actionStart_Update->setEnabled(false);
@@ -191,20 +638,132 @@ MainWindow::stopTagUpdate(void) {
 
 void
 MainWindow::updateTags(void) {
-    TagRootItem *item;
+    RootTag *r;
+    qint64 now;
     int result;
+    TraceScope span("updateTags");
+
+    now = QDateTime::currentMSecsSinceEpoch();
+    for(int n=0; n < _tagModel->rootCount(); n++) {
+        r = _tagModel->root(n);
+        if(r->paged) continue;
+        result = dax->read(r->h, r->data);
+        if(Dax::connectionError(result)) {
+            connectionLost();
+            return;
+        }
+        if(result == ERR_OK) r->version = _valueCache->update(r->h, r->data, now);
+        r->lastRead = now;
+    }
+    _tagModel->updateTags(now);
+    _tagModel->flushChanges();
+
+}
+
 
-    for(int n=0; n < treeWidget->topLevelItemCount(); n++) {
-        item = (TagRootItem *)treeWidget->topLevelItem(n);
-        result = dax.read(item->handle(), item->getData());
-        item->updateValues();
+/* Called by the tag timer.  The scheduler plans the reads, visible rows
+   first, and the poll thread reads what it can in it's time budget.  The
+   rest waits for the next tick.  In adaptive mode each tag has it's own
+   interval that doubles every time that we read it and it hasn't changed,
+   up to the max, and goes back to the timer interval as soon as it does.
+   Skipped tags count as saved reads.  A tick that comes while the thread
+   is still reading is passed over. */
+void
+MainWindow::pollTags(void) {
+    TraceScope span("pollTags");
+
+    if(_polling || _pollWorker == nullptr) return;
+    _pollNow = QDateTime::currentMSecsSinceEpoch();
+    _scheduler->setIntervals(actionAdaptive_Polling->isChecked(), spinBoxInterval->value(),
+                             spinBoxMaxInterval->value());
+    _pollWorker->setPlan(_scheduler->plan(visibleTags(), _pollNow), SCHEDULE_BUDGET);
+    _polling = true;
+    QMetaObject::invokeMethod(_pollWorker, &PollWorker::read, Qt::QueuedConnection);
+}
+
+
+/* The poll thread is done with the plan so the results go into the model */
+void
+MainWindow::pollDone(void) {
+    qint64 now = _pollNow;
+    TraceScope span("pollDone");
+
+    if(!_polling) return;
+    _polling = false;
+    if(Dax::connectionError(_pollWorker->result())) {
+        connectionLost();
+        return;
+    }
+    _scheduler->apply(_pollWorker->data(), _pollWorker->status(), _pollWorker->count(), now);
+    /* Only what was read on this tick needs to be compared */
+    _tagModel->updateTags(_scheduler->polled(), now);
+    _scheduler->finish(now);
+    _tagModel->markStale(now);
+    _tagModel->flushChanges();
+    _pollSkipped += _scheduler->takeSkipped();
+    if(_pollWindow.elapsed() >= POLL_REPORT_TIME) {
+        labelPollSaved->setText(QString("%1 reads/s saved").arg(_pollSkipped * 1000.0 / _pollWindow.elapsed(), 0, 'f', 1));
+        _pollSkipped = 0;
+        _pollWindow.restart();
     }
+}
+
+
+/* The tags that have a row on the screen, in the order they are shown */
+std::vector<RootTag *>
+MainWindow::visibleTags(void) {
+    std::vector<RootTag *> tags;
+    QModelIndex index;
+    RootTag *r;
+    int bottom;
 
+    if(!treeView->isVisible()) return tags;
+    bottom = treeView->viewport()->height();
+    index = treeView->indexAt(QPoint(0, 0));
+    while(index.isValid() && treeView->visualRect(index).top() < bottom) {
+        r = _tagModel->rootOf(_tagSort->mapToSource(index));
+        if(r && (tags.empty() || tags.back() != r)) tags.push_back(r);
+        index = treeView->indexBelow(index);
+    }
+    return tags;
+}
+
+
+void
+MainWindow::treeExpanded(const QModelIndex &index) {
+    RootTag *r = _tagModel->rootOf(_tagSort->mapToSource(index));
+
+    if(r) _scheduler->expanded(r->idx);
+}
+
+
+/* Only the top level row going away takes the tag out of the expanded
+   tier.  Members that are collapsed still have their tag open. */
+void
+MainWindow::treeCollapsed(const QModelIndex &index) {
+    RootTag *r;
+
+    if(index.parent().isValid()) return;
+    r = _tagModel->rootOf(_tagSort->mapToSource(index));
+    if(r) _scheduler->collapsed(r->idx);
+}
+
+
+/* Every tag starts over at the timer interval when this is turned on */
+void
+MainWindow::adaptivePolling(bool checked) {
+    for(int n=0; n < _tagModel->rootCount(); n++) {
+        _tagModel->root(n)->pollInterval = 0;
+        _tagModel->root(n)->nextPoll = 0;
+    }
+    _pollSkipped = 0;
+    _pollWindow.restart();
 }
 
 void
 MainWindow::updateTime(int msec) {
     tagTimer->setInterval(msec);
+    _tagModel->setStaleTime(msec);
 }
 
 void
@@ -215,20 +774,19 @@ MainWindow::aboutDialog(void) {
 
 void
 MainWindow::treeContextMenu(const QPoint& pos) {
-    TagBaseItem *item;
-    QList<QTreeWidgetItem *> items;
+    QModelIndex index;
     QMenu menu;
 
-    items = treeWidget->selectedItems();
-    if(items.size() > 0) {
-        item = (TagBaseItem *)items[0];
-        QString str = items[0]->data(0, Qt::DisplayRole).toString();
-
+    index = currentTag();
+    if(index.isValid()) {
         menu.addAction(actionDelete_Tag);
         menu.addAction(actionAdd_To_Watchlist);
+        if(_tagModel->nodeCount(index) > 1 && !dax->isCustom(_tagModel->nodeType(index))) {
+            menu.addAction(actionArray_View);
+        }
         menu.addSeparator();
         menu.addAction(actionTag_Info);
-        menu.exec(treeWidget->mapToGlobal(pos));
+        menu.exec(treeView->viewport()->mapToGlobal(pos));
     }
 }
 
@@ -238,37 +796,45 @@ MainWindow::treeWatchContextMenu(const QPoint& pos) {
     QList<QTreeWidgetItem *> items;
     QMenu menu;
 
-    items = treeWidget->selectedItems();
+    items = treeWidgetWatch->selectedItems();
     if(items.size() > 0) {
         item = (WatchItem *)items[0];
         QString str = items[0]->data(0, Qt::DisplayRole).toString();
 
         menu.addAction(actionDelete_From_Watchlist);
+        if(item->type() != ITEM_TYPE_EXPR && item->type() != ITEM_TYPE_LEAF) {
+            menu.addAction(actionWatch_Filter);
+        }
         //menu.addAction(actionAdd_To_Watchlist);
         menu.addSeparator();
         //menu.addAction(actionTag_Info);
-        menu.exec(treeWidget->mapToGlobal(pos));
+        menu.exec(treeWidgetWatch->mapToGlobal(pos));
     }
 
 }
 
 /* This activates the edit box at the top of the tag view tab*/
 void
-MainWindow::treeItemActivate(QTreeWidgetItem *item, int column) {
-    TagBaseItem *tagitem = (TagBaseItem *)item;
+MainWindow::treeItemActivate(const QModelIndex &proxyIndex) {
+    QModelIndex index = _tagSort->mapToSource(proxyIndex);
     tag_handle h;
     void *data;
+    qint64 now;
 
-    if(tagitem->writable && !tagitem->readonly) {
-        h = tagitem->handle();
+    if(_tagModel->isWritable(index) && !_tagModel->isReadonly(index)) {
+        if(_tagModel->nodeCount(index) > 1 || dax->isCustom(_tagModel->nodeType(index))) return; // Need to deal with CHAR[] at some point
+        if(_tagModel->nodeHandle(index, &h)) return;
 
-        if(h.count > 1 || dax.isCustom(h.type)) return; // Need to deal with CHAR[] at some point
-
-        data = malloc(h.size);
-        int result = dax.read(h, data);
-        if(result) { free(data); return; } // Probably should indicate this error
-        lineEditTree->setText(QString(dax.valueString(h.type, data, 0).c_str()));
-        free(data);
+        if(_scratch.size() < h.size) _scratch.resize(h.size);
+        data = _scratch.data();
+        now = QDateTime::currentMSecsSinceEpoch();
+        /* The tree or a watch has probably just read it */
+        if(!_valueCache->fetch(h, data, now, spinBoxInterval->value())) {
+            int result = dax->read(h, data);
+            if(result) return; // Probably should indicate this error
+            _valueCache->update(h, data, now);
+        }
+        lineEditTree->setText(QString(dax->valueString(h.type, data, 0).c_str()));
         lineEditTree->selectAll();
         lineEditTree->setVisible(true);
         lineEditTree->setFocus(Qt::OtherFocusReason);
@@ -282,43 +848,44 @@ MainWindow::treeItemActivate(QTreeWidgetItem *item, int column) {
 /* This gets called any time we changed the selected item in the tree.  It's
    mainly for updating actions depending on what is selected */
 void
-MainWindow::treeItemChanged(QTreeWidgetItem *current, QTreeWidgetItem *previous) {
-    TagBaseItem *item = (TagBaseItem *)current;
-    if(item) {
-        if(item->writable) actionAdd_To_Watchlist->setEnabled(true);
-        else actionAdd_To_Watchlist->setEnabled(false);
-    }
+MainWindow::treeItemChanged(const QModelIndex &current, const QModelIndex &previous) {
+    /* Anything can be watched, even whole arrays and structures */
+    actionAdd_To_Watchlist->setEnabled(current.isValid());
 }
 
 
 void
 MainWindow::editAccept(void) {
-    TagBaseItem *item;
+    QModelIndex index;
+    RootTag *r;
     tag_handle h;
     void *data;
     int result;
-    QString str;
 
-    item = (TagBaseItem *)treeWidget->currentItem();
+    index = currentTag();
     lineEditTree->setVisible(false);
     toolButtonAccept->setVisible(false);
-    treeWidget->setFocus(Qt::OtherFocusReason);
-
-    h = item->handle();
-    data = malloc(h.size);
-    dax.value(lineEditTree->text().toStdString(), h.type, data, 0);
-    result = dax.write(h, data, NULL); /* Write the data to the server */
-    if(result) { free(data); return; } // Probably should indicate this error
-    result = dax.read(h, data); /* Read it back to make sure */
-    if(result) { free(data); return; } // Probably should indicate this error
-    if(h.type == DAX_BOOL) {
-        if( ((char *)data)[0] ) str = "true";
-        else                    str = "false";
-    } else {
-        str = dax.valueString(h.type, data, 0).c_str();
-    }
-    item->setData(VALUE_COLUMN, Qt::DisplayRole, str);
-    free(data);
+    treeView->setFocus(Qt::OtherFocusReason);
+
+    if(_tagModel->nodeHandle(index, &h)) return;
+    if(_scratch.size() < h.size) _scratch.resize(h.size);
+    data = _scratch.data();
+    memset(data, 0, h.size);
+    dax->value(lineEditTree->text().toStdString(), h.type, data, 0);
+    result = dax->write(h, data, NULL); /* Write the data to the server */
+    if(result) return; // Probably should indicate this error
+    /* Read the whole tag back to make sure */
+    r = _tagModel->rootOf(index);
+    if(r->paged) return;
+    result = dax->read(r->h, r->data);
+    if(result) return; // Probably should indicate this error
+    r->lastRead = QDateTime::currentMSecsSinceEpoch();
+    r->version = _valueCache->update(r->h, r->data, r->lastRead);
+    _tagModel->updateTag(r, r->lastRead);
+    _tagModel->flushChanges();
+    /* We just changed it so go back to polling it at the full rate */
+    r->pollInterval = 0;
+    r->nextPoll = 0;
 }
 
 void
@@ -330,7 +897,7 @@ MainWindow::addTag(void) {
     uint32_t count;
     int result;
 
-    types = dax.getTypes();
+    types = dax->getTypes();
     for(type_id type : types) {
         d.comboBoxType->addItem(QString(type.name.c_str()), type.type);
     }
@@ -340,7 +907,7 @@ MainWindow::addTag(void) {
         tagname = d.lineEditName->text().toStdString();
         tagType = (tag_type)d.comboBoxType->currentData().toInt();
         count = d.spinBoxCount->value();
-        result = dax.tagAdd(NULL, tagname, tagType, count);
+        result = dax->tagAdd(NULL, tagname, tagType, count);
         if(result == ERR_OK) {
             str = std::string("Tag '") + tagname + "' Added";
             statusbar->showMessage(str.c_str());
@@ -353,23 +920,22 @@ MainWindow::addTag(void) {
 
 void
 MainWindow::deleteTag(void) {
-    TagBaseItem *item;
+    RootTag *r;
     QMessageBox msgBox(this);
     tag_index idx;
     int result;
 
     if(tabWidget->currentIndex() == 0) {
-        item = (TagBaseItem *)treeWidget->currentItem();
-        /* This loop takes us back to the root tag item */
-        while(item->type() == ITEM_TYPE_LEAF) item = (TagBaseItem *)item->parent();
-        idx = item->handle().index;
-        QString tagname = item->data(0, Qt::DisplayRole).toString();
+        r = _tagModel->rootOf(currentTag());
+        if(r == nullptr) return;
+        idx = r->idx;
+        QString tagname = _tagModel->nodeName(_tagModel->rootIndex(r));
         msgBox.setStandardButtons(QMessageBox::Yes | QMessageBox::No);
         msgBox.setText(QString("Are you sure you want to delete tag '" + tagname + "'?"));
         msgBox.setWindowTitle(QString("Delete Tag"));
         result = msgBox.exec();
         if(result == QMessageBox::Yes) {
-            result = dax.tagDel(idx);
+            result = dax->tagDel(idx);
             if(result == ERR_OK) {
                 statusbar->showMessage("Tag Deleted Successfully");
             } else {
@@ -386,7 +952,7 @@ MainWindow::deleteTag(void) {
 void
 MainWindow::addType(void) {
     int result;
-    AddTypeDialog d(this);
+    AddTypeDialog d(dax, this);
     TypeItem *item;
     std::vector<type_id> members;
     type_id t;
@@ -402,7 +968,7 @@ MainWindow::addType(void) {
             t.count = item->count;
             members.push_back(t);
         }
-        result = dax.typeAdd(d.lineEditName->text().toStdString(), members);
+        result = dax->typeAdd(d.lineEditName->text().toStdString(), members);
         if(result == ERR_OK) {
             statusbar->showMessage("Type Created");
         } else {
@@ -415,13 +981,12 @@ MainWindow::addType(void) {
 
 void
 MainWindow::addToWatchlist(void) {
-    TagBaseItem *item;
     WatchItem *watchitem;
 
-    item = (TagBaseItem *)treeWidget->currentItem();
-    QString tagname = item->data(0, Qt::DisplayRole).toString();
+    if(_watchlistName.isEmpty()) _watchlistName = "Default";
+    QString tagname = _tagModel->nodeName(currentTag());
     try {
-        watchitem = new WatchItem(treeWidgetWatch, tagname.toStdString().c_str());
+        watchitem = new WatchItem(treeWidgetWatch, dax, _watchArena, _valueCache, _watchNotifier, tagname.toStdString().c_str());
     }
     catch(int x) {
         statusbar->showMessage(QString("Unable to add tag to watchlist - ") + dax_errstr(x));
@@ -431,13 +996,561 @@ MainWindow::addToWatchlist(void) {
     treeWidgetWatch->addTopLevelItem(watchitem);
 }
 
+/* Adds a watch that is calculated from other tags */
 void
-MainWindow::delFromWatchlist(void) {
+MainWindow::addExpression(void) {
+    QString text, error;
+    bool ok;
+
+    if(!dax->isConnected()) return;
+    text = QInputDialog::getText(this, "Add Expression", "Expression:", QLineEdit::Normal, "", &ok);
+    if(!ok || text.trimmed().isEmpty()) return;
+    if(_watchlistName.isEmpty()) _watchlistName = "Default";
+    try {
+        new ExprItem(treeWidgetWatch, _exprEngine, _exprNotifier, text.trimmed(), &error);
+    }
+    catch(int x) {
+        statusbar->showMessage("Unable to add expression - " + error);
+    }
+}
+
+
+/* Watches normally get an event for every change.  A deadband or a
+   threshold is done by the server so the changes that don't pass it never
+   come over the connection. */
+void
+MainWindow::watchFilter(void) {
+    static const int types[] = {EVENT_CHANGE, EVENT_DEADBAND, EVENT_GREATER, EVENT_LESS, EVENT_EQUAL};
+    QStringList kinds({"Any Change", "Deadband", "Greater Than", "Less Than", "Equal To"});
+    QList<QTreeWidgetItem *> items;
     WatchItem *item;
+    QString kind, value;
+    int current = 0, n, result;
+    bool ok;
+
+    items = treeWidgetWatch->selectedItems();
+    if(items.isEmpty()) return;
+    if(items[0]->type() == ITEM_TYPE_EXPR || items[0]->type() == ITEM_TYPE_LEAF) return;
+    item = (WatchItem *)items[0];
+    for(n=0;n<kinds.size();n++) {
+        if(types[n] == item->filterType()) current = n;
+    }
+    kind = QInputDialog::getItem(this, "Event Filter", "Send an event on:", kinds, current, false, &ok);
+    if(!ok) return;
+    n = kinds.indexOf(kind);
+    if(types[n] != EVENT_CHANGE) {
+        value = QInputDialog::getText(this, "Event Filter", kind + ":", QLineEdit::Normal,
+                                      item->filterValue(), &ok);
+        if(!ok || value.isEmpty()) return;
+    }
+    result = item->setFilter(types[n], value);
+    if(result) {
+        statusbar->showMessage(QString("Unable to set the event filter - ") + dax_errstr(result));
+    }
+}
+
+
+/* Turning it off asks where to put what was recorded */
+void
+MainWindow::recordTrace(bool checked) {
+    QString path;
+    int result;
+
+    if(checked) {
+        Trace::clear();
+        Trace::enable(true);
+        statusbar->showMessage("Recording trace");
+        return;
+    }
+    Trace::enable(false);
+    path = QFileDialog::getSaveFileName(this, "Save Trace", "qdax-trace.json", "Trace Files (*.json)");
+    if(path.isEmpty()) return;
+    result = Trace::dump(path.toLocal8Bit().constData());
+    if(result) statusbar->showMessage("Unable to save trace " + path + " - " + dax_errstr(result));
+    else       statusbar->showMessage("Trace saved to " + path);
+}
+
+/* Makes the alarm and it's row in the alarms panel */
+AlarmItem *
+MainWindow::addAlarmItem(int kind, QString text, double limit, double deadband, QString *error) {
+    AlarmItem *item;
+    int id;
+
+    id = _alarmEngine->add(kind, text, limit, deadband, error);
+    if(id < 0) return nullptr;
+    item = new AlarmItem(treeWidgetAlarms, _alarmEngine->alarm(id));
+    _alarmItems.insert(id, item);
+    return item;
+}
+
+
+void
+MainWindow::addAlarm(void) {
+    AlarmDialog dialog(this);
+    QString text, error;
+
+    if(!dax->isConnected()) return;
+    if(dialog.exec() != QDialog::Accepted) return;
+    text = dialog.lineEditExpression->text().trimmed();
+    if(text.isEmpty()) return;
+    if(addAlarmItem(dialog.comboBoxKind->currentData().toInt(), text, dialog.doubleSpinBoxLimit->value(),
+                    dialog.doubleSpinBoxDeadband->value(), &error) == nullptr) {
+        statusbar->showMessage("Unable to add alarm - " + error);
+        return;
+    }
+    storeAlarms();
+}
+
+
+void
+MainWindow::deleteAlarm(void) {
+    AlarmItem *item;
+
+    item = (AlarmItem *)treeWidgetAlarms->currentItem();
+    if(item == nullptr) return;
+    _alarmEngine->remove(item->id);
+    _alarmItems.remove(item->id);
+    delete item;
+    storeAlarms();
+}
+
+
+/* The alarm engine tells us about each change of state from the event
+   thread.  The alarm may have been deleted while the signal was queued. */
+void
+MainWindow::alarmChanged(int id, bool active, bool firstOut, double value, qint64 since) {
+    AlarmItem *item = _alarmItems.value(id, nullptr);
+
+    if(item == nullptr) return;
+    item->update(active, firstOut, value, since);
+    if(active && firstOut) statusbar->showMessage("Alarm - " + item->text(ALARM_NAME_COLUMN));
+}
+
+
+void
+MainWindow::treeAlarmContextMenu(const QPoint& pos) {
+    QMenu menu;
+
+    menu.addAction(actionAdd_Alarm);
+    if(treeWidgetAlarms->currentItem()) menu.addAction(actionDelete_Alarm);
+    menu.exec(treeWidgetAlarms->viewport()->mapToGlobal(pos));
+}
+
+
+/* Alarms are kept for each server as "kind;limit;deadband;expression" */
+void
+MainWindow::storeAlarms(void) {
+    QSettings settings;
+    QStringList alarms;
+
+    for(Alarm *a : _alarmEngine->alarms()) {
+        alarms.append(QString("%1;%2;%3;%4").arg(a->kind).arg(a->limit, 0, 'g', 17)
+                      .arg(a->deadband, 0, 'g', 17).arg(a->expr.text()));
+    }
+    settings.setValue("alarms/" + _tagCache->id(), alarms);
+}
+
+
+void
+MainWindow::restoreAlarms(void) {
+    QSettings settings;
+    QStringList fields;
+    QString error;
+
+    for(QString s : settings.value("alarms/" + _tagCache->id()).toStringList()) {
+        fields = s.split(';');
+        if(fields.size() < 4) continue;
+        /* The expression is last so that it can have a ';' in it */
+        if(addAlarmItem(fields[0].toInt(), fields.mid(3).join(';'), fields[1].toDouble(),
+                        fields[2].toDouble(), &error) == nullptr) {
+            dax_log(DAX_LOG_ERROR, "Unable to restore alarm %s - %s",
+                    fields.mid(3).join(';').toStdString().c_str(), error.toStdString().c_str());
+        }
+    }
+}
+
+/* Reads every tag on the server into a snapshot file */
+void
+MainWindow::captureSnapshot(void) {
+    QElapsedTimer timer;
+    Snapshot snapshot;
+    QString path;
+    int result;
+
+    if(!dax->isConnected()) return;
+    path = QFileDialog::getSaveFileName(this, "Capture Snapshot", QString(), "Snapshots (*.qdxs)");
+    if(path.isEmpty()) return;
+    timer.start();
+    QGuiApplication::setOverrideCursor(Qt::WaitCursor);
+    result = snapshot.capture(dax, _tagModel, QThread::idealThreadCount());
+    if(result == ERR_OK) result = snapshot.save(path);
+    QGuiApplication::restoreOverrideCursor();
+    if(result) {
+        statusbar->showMessage(QString("Unable to capture snapshot - ") + dax_errstr(result));
+        return;
+    }
+    statusbar->showMessage(QString("Captured %1 tags, %2 bytes in %3 ms")
+                           .arg(snapshot.tagCount()).arg(snapshot.size()).arg(timer.elapsed()));
+}
+
+
+Snapshot *
+MainWindow::loadSnapshot(QString path) {
+    Snapshot *snapshot = new Snapshot;
+    int result;
+
+    result = snapshot->load(path);
+    if(result) {
+        statusbar->showMessage("Unable to open snapshot " + path + " - " + dax_errstr(result));
+        delete snapshot;
+        return nullptr;
+    }
+    return snapshot;
+}
+
+
+void
+MainWindow::showDiff(Snapshot *before, Snapshot *after, QString title) {
+    std::vector<SnapshotChange> changes;
+    SnapshotView *view;
+    uint64_t total;
+
+    QGuiApplication::setOverrideCursor(Qt::WaitCursor);
+    total = Snapshot::diff(before, after, dax, &changes, QThread::idealThreadCount());
+    QGuiApplication::restoreOverrideCursor();
+    view = new SnapshotView(changes, total, title, this);
+    view->setAttribute(Qt::WA_DeleteOnClose);
+    view->show();
+}
+
+
+/* This works without a connection */
+void
+MainWindow::openSnapshot(void) {
+    SnapshotView *view;
+    Snapshot *snapshot;
+    QString path;
+
+    path = QFileDialog::getOpenFileName(this, "Open Snapshot", QString(), "Snapshots (*.qdxs)");
+    if(path.isEmpty()) return;
+    snapshot = loadSnapshot(path);
+    if(snapshot == nullptr) return;
+    view = new SnapshotView(dax, snapshot, QFileInfo(path).fileName(), this);
+    view->setAttribute(Qt::WA_DeleteOnClose);
+    view->show();
+}
+
+
+void
+MainWindow::compareSnapshots(void) {
+    Snapshot *before, *after;
+    QString first, second;
+
+    first = QFileDialog::getOpenFileName(this, "Before Snapshot", QString(), "Snapshots (*.qdxs)");
+    if(first.isEmpty()) return;
+    second = QFileDialog::getOpenFileName(this, "After Snapshot", QFileInfo(first).path(), "Snapshots (*.qdxs)");
+    if(second.isEmpty()) return;
+    before = loadSnapshot(first);
+    if(before == nullptr) return;
+    after = loadSnapshot(second);
+    if(after) {
+        showDiff(before, after, QFileInfo(first).fileName() + " - " + QFileInfo(second).fileName());
+        delete after;
+    }
+    delete before;
+}
+
+
+/* Takes a snapshot of the server in memory and compares a file to it */
+void
+MainWindow::compareLive(void) {
+    Snapshot *before;
+    Snapshot live;
+    QString path;
+    int result;
+
+    if(!dax->isConnected()) return;
+    path = QFileDialog::getOpenFileName(this, "Compare Snapshot", QString(), "Snapshots (*.qdxs)");
+    if(path.isEmpty()) return;
+    before = loadSnapshot(path);
+    if(before == nullptr) return;
+    QGuiApplication::setOverrideCursor(Qt::WaitCursor);
+    result = live.capture(dax, _tagModel, QThread::idealThreadCount());
+    QGuiApplication::restoreOverrideCursor();
+    if(result) {
+        statusbar->showMessage(QString("Unable to read the server - ") + dax_errstr(result));
+    } else {
+        showDiff(before, &live, QFileInfo(path).fileName() + " - Live");
+    }
+    delete before;
+}
+
+/* Freezing keeps a copy of every tag in the tree so that the tree can
+   show what has changed since */
+void
+MainWindow::freezeTags(bool checked) {
+    if(checked) {
+        _tagModel->freeze();
+        statusbar->showMessage("Frozen at " + QDateTime::currentDateTime().time().toString());
+    } else {
+        _tagModel->thaw();
+    }
+}
+
+/* Opens a paged view of the selected array.  The dialog deletes itself
+   when it's closed. */
+void
+MainWindow::arrayView(void) {
+    QModelIndex index;
+    ArrayView *view;
+    tag_handle h;
+
+    index = currentTag();
+    if(_tagModel->nodeHandle(index, &h)) return;
+    view = new ArrayView(dax, _tagModel->nodeName(index), h, spinBoxInterval->value(), this);
+    view->setAttribute(Qt::WA_DeleteOnClose);
+    view->show();
+}
+
+
+/* Finds the row in the hot tags panel for the given tag, or makes a new
+   one if we haven't seen it before */
+HotTagItem *
+MainWindow::hotItem(QString name, QString source, HotTagItem *parent) {
+    HotTagItem *item;
+    QString key = source + ":" + name;
+
+    item = _hotItems.value(key, nullptr);
+    if(item == nullptr) {
+        if(parent == nullptr) item = new HotTagItem(treeWidgetHot, name, source);
+        else                  item = new HotTagItem(parent, name, source);
+        _hotItems.insert(key, item);
+    }
+    return item;
+}
+
+
+/* Drops the row of a tag that has gone away along with the rows of it's
+   members */
+void
+MainWindow::removeHotItem(QString name, QString source) {
+    HotTagItem *item;
+
+    item = _hotItems.take(source + ":" + name);
+    if(item == nullptr) return;
+    for(int n=0; n < item->childCount(); n++) {
+        _hotItems.remove(source + ":" + item->child(n)->text(HOT_NAME_COLUMN));
+    }
+    delete item;
+}
+
+
+/* Turns the activity counters of the tag tree and the watchlist into rates
+   in the hot tags panel.  Tags that have never changed are left out.
+   Sorting is turned off while we update so that the tree is only sorted
+   once. */
+void
+MainWindow::updateHotTags(void) {
+    RootTag *r;
+    WatchItem *watch;
+    HotTagItem *item;
+    qint64 now;
+
+    if(_tagModel->rootCount() == 0 && treeWidgetWatch->topLevelItemCount() == 0) return;
+    now = QDateTime::currentMSecsSinceEpoch();
+    treeWidgetHot->setSortingEnabled(false);
+    for(int n=0; n < _tagModel->rootCount(); n++) {
+        r = _tagModel->root(n);
+        if(r->activity.changes == 0) continue;
+        item = hotItem(_tagModel->nodeName(_tagModel->rootIndex(r)), "Poll");
+        item->update(r->activity.changes, r->activity.bytes, r->activity.last, now);
+        for(size_t i=0; i < r->members.size(); i++) {
+            TagActivity &a = r->members[i];
+            if(a.changes == 0) continue;
+            hotItem(_tagModel->childName(r, i), "Poll", item)->update(a.changes, a.bytes, a.last, now);
+        }
+    }
+    for(int n=0; n < treeWidgetWatch->topLevelItemCount(); n++) {
+        if(treeWidgetWatch->topLevelItem(n)->type() == ITEM_TYPE_EXPR) continue;
+        watch = (WatchItem *)treeWidgetWatch->topLevelItem(n);
+        if(watch->changes == 0) continue;
+        item = hotItem(watch->text(0), "Event");
+        item->update(watch->changes, watch->changeBytes, watch->lastChange, now);
+    }
+    treeWidgetHot->setSortingEnabled(true);
+}
+
+
+void
+MainWindow::delFromWatchlist(void) {
+    QTreeWidgetItem *item;
     int index;
 
-    item = (WatchItem *)treeWidgetWatch->currentItem();
+    if(_loader) return; /* The loader is still working on the items */
+    item = treeWidgetWatch->currentItem();
+    if(item == nullptr) return;
+    /* Members of an array or structure go with the whole watch */
+    while(item->parent()) item = item->parent();
     index = treeWidgetWatch->indexOfTopLevelItem(item);
     treeWidgetWatch->takeTopLevelItem(index);
+    if(item->type() != ITEM_TYPE_EXPR) removeHotItem(item->text(0), "Event");
     delete item;
-}
\ No newline at end of file
+}
+
+
+/* Saves the names of the tags in the watchlist under the given name.
+   Expressions are saved with an '=' in front so we can tell them apart. */
+void
+MainWindow::storeWatchlist(QString name) {
+    QSettings settings;
+    QStringList tags;
+    QTreeWidgetItem *item;
+
+    for(int n=0; n < treeWidgetWatch->topLevelItemCount(); n++) {
+        item = treeWidgetWatch->topLevelItem(n);
+        if(item->type() == ITEM_TYPE_EXPR) {
+            tags.append("=" + item->text(0));
+        } else if(((WatchItem *)item)->filterType() != EVENT_CHANGE) {
+            /* Filtered watches are "tagname;event type;value" */
+            tags.append(QString("%1;%2;%3").arg(item->text(0)).arg(((WatchItem *)item)->filterType())
+                        .arg(((WatchItem *)item)->filterValue()));
+        } else {
+            tags.append(item->text(0));
+        }
+    }
+    settings.setValue("watchlists/" + name, tags);
+    settings.setValue("watchlist/current/" + _tagCache->id(), name);
+}
+
+
+void
+MainWindow::saveWatchlist(void) {
+    bool ok;
+
+    QString name = QInputDialog::getText(this, "Save Watchlist", "Watchlist Name:",
+                                         QLineEdit::Normal, _watchlistName, &ok);
+    if(!ok || name.isEmpty()) return;
+    _watchlistName = name;
+    storeWatchlist(name);
+    statusbar->showMessage("Watchlist '" + name + "' Saved");
+}
+
+
+void
+MainWindow::loadWatchlist(void) {
+    QSettings settings;
+    QStringList names;
+    bool ok;
+
+    settings.beginGroup("watchlists");
+    names = settings.childKeys();
+    settings.endGroup();
+    if(names.isEmpty()) {
+        statusbar->showMessage("No saved watchlists");
+        return;
+    }
+    QString name = QInputDialog::getItem(this, "Load Watchlist", "Watchlist:",
+                                         names, qMax(0, (int)names.indexOf(_watchlistName)), false, &ok);
+    if(!ok) return;
+    /* Keep what we have before it's replaced */
+    if(!_watchlistName.isEmpty()) storeWatchlist(_watchlistName);
+    restoreWatchlist(name);
+}
+
+
+/* Replaces the watchlist with a saved one.  The items are made here as
+   placeholders and a WatchLoader on it's own thread subscribes them all in
+   one go. */
+void
+MainWindow::restoreWatchlist(QString name) {
+    QSettings settings;
+    QList<WatchItem *> items;
+    QStringList fields;
+
+    if(_loader || !dax->isConnected()) return;
+    _watchlistName = name;
+    treeWidgetWatch->clear();
+    for(QString tagname : settings.value("watchlists/" + name).toStringList()) {
+        if(tagname.startsWith("=")) {
+            /* These are subscribed right here on the GUI thread.  Each tag
+               that no other expression uses yet costs a getHandle(), a read,
+               an eventAdd() and an eventOptions() so a long list of them
+               holds up the window while it loads. */
+            try {
+                new ExprItem(treeWidgetWatch, _exprEngine, _exprNotifier, tagname.mid(1));
+            }
+            catch(int x) {
+                dax_log(DAX_LOG_ERROR, "Unable to restore expression %s", tagname.toStdString().c_str());
+            }
+            continue;
+        }
+        fields = tagname.split(';');
+        items.append(new WatchItem(treeWidgetWatch, dax, _watchArena, _valueCache, _watchNotifier, fields[0], false));
+        if(fields.size() >= 3) items.last()->setFilter(fields[1].toInt(), fields[2]);
+    }
+    if(items.isEmpty()) return;
+
+    _loaderTime.start();
+    _loaderThread = new QThread();
+    _loader = new WatchLoader(dax, _valueCache, items);
+    _loader->moveToThread(_loaderThread);
+    QObject::connect(_loader, &WatchLoader::resolved, this, &MainWindow::watchesResolved);
+    QObject::connect(_loader, &WatchLoader::subscribed, this, &MainWindow::watchesSubscribed);
+    _loaderThread->start();
+    QMetaObject::invokeMethod(_loader, &WatchLoader::resolve, Qt::QueuedConnection);
+    statusbar->showMessage(QString("Restoring %1 watches").arg(items.size()));
+}
+
+
+/* The handles are in so we can give the items their buffers */
+void
+MainWindow::watchesResolved(void) {
+    QList<WatchItem *> items;
+    WatchItem *item;
+
+    if(_loader == nullptr) return;
+    items = _loader->items();
+    for(int n=0; n < items.size(); n++) {
+        item = items[n];
+        item->status = _loader->status(n);
+        if(item->status) continue;
+        item->setHandle(_loader->handle(n));
+        item->allocate();
+    }
+    QMetaObject::invokeMethod(_loader, &WatchLoader::subscribe, Qt::QueuedConnection);
+}
+
+
+void
+MainWindow::watchesSubscribed(void) {
+    int count = 0;
+
+    if(_loader == nullptr) return;
+    for(WatchItem *item : _loader->items()) {
+        if(item->status == ERR_OK) {
+            item->showValue();
+            count++;
+        } else {
+            item->setData(1, Qt::DisplayRole, QString("<") + dax_errstr(item->status) + ">");
+        }
+    }
+    statusbar->showMessage(QString("Restored %1 of %2 watches from '%3' in %4 ms")
+                           .arg(count).arg(_loader->items().size()).arg(_watchlistName)
+                           .arg(_loaderTime.elapsed()));
+    stopLoader();
+}
+
+
+/* Waits for the loader to finish whatever it's in the middle of.  If it
+   didn't get all the way through the items that it didn't get to are left
+   with their placeholder text. */
+void
+MainWindow::stopLoader(void) {
+    if(_loaderThread == nullptr) return;
+    _loaderThread->quit();
+    _loaderThread->wait();
+    delete _loaderThread;
+    delete _loader;
+    _loaderThread = nullptr;
+    _loader = nullptr;
+}
@@ -22,14 +22,34 @@
 #include "ui_mainwindow.h"
 #include <QThread>
 #include <QTimer>
+#include <QHash>
+#include <QElapsedTimer>
 #include "dax.h"
-#include "tagitem.h"
+#include "tagmodel.h"
+#include "tagcache.h"
 #include "watchitem.h"
+#include "watchloader.h"
+#include "expression.h"
+#include "alarm.h"
+#include "alarmdialog.h"
+#include "snapshot.h"
+#include "snapshotview.h"
 #include "eventworker.h"
 #include "aboutdialog.h"
 #include "addtagdialog.h"
 #include "addtypedialog.h"
+#include "arrayview.h"
+#include "hottags.h"
+#include "scheduler.h"
+#include "trace.h"
+#include "arena.h"
 
+/* Reconnect backoff limits in milliseconds */
+#define RECONNECT_MIN_DELAY 1000
+#define RECONNECT_MAX_DELAY 30000
+
+/* How often the reads saved by adaptive polling are shown */
+#define POLL_REPORT_TIME 1000
 
 
 class MainWindow : public QMainWindow, public Ui_MainWindow
@@ -37,35 +57,116 @@ class MainWindow : public QMainWindow, public Ui_MainWindow
     Q_OBJECT
 
     private:
+        Dax *dax;
         QThread *eventThread;
         EventWorker *eventworker;
+        QThread *_loaderThread;
+        WatchLoader *_loader;
+        QElapsedTimer _loaderTime;
+        QString _watchlistName;
+        ExprEngine *_exprEngine;
+        ExprNotifier *_exprNotifier;
+        WatchNotifier *_watchNotifier;
+        AlarmEngine *_alarmEngine;
+        QHash<int, AlarmItem *> _alarmItems;
         QTimer *tagTimer;
+        QTimer *reconnectTimer;
+        QTimer *hotTimer;
         AboutDialog *_aboutDialog;
+        TagModel *_tagModel;
+        TagSortModel *_tagSort;
+        TagScheduler *_scheduler;
+        ValueCache *_valueCache;
+        TagCache *_tagCache;
+        ServerState _serverState;
+        QHash<QString, HotTagItem *> _hotItems;
+        TagArena *_tagArena;
+        TagArena *_watchArena;
+        std::vector<uint8_t> _scratch;
+        int _reconnectDelay;
+        QElapsedTimer _pollWindow;
+        uint64_t _pollSkipped;
+        QThread *_pollThread;
+        PollWorker *_pollWorker;
+        bool _polling;      /* The poll thread is working on a plan */
+        qint64 _pollNow;    /* The tick that it's working on */
+        bool _resumeUpdate;
+
+        void startEventThread(void);
+        void stopEventThread(void);
+        void startPollThread(void);
+        void stopPollThread(void);
+        int loadTags(void);
+        void saveTags(void);
+        void resyncTags(void);
+        void resubscribeWatches(void);
+        void storeWatchlist(QString name);
+        void restoreWatchlist(QString name);
+        void stopLoader(void);
+        void storeAlarms(void);
+        void restoreAlarms(void);
+        Snapshot *loadSnapshot(QString path);
+        void showDiff(Snapshot *before, Snapshot *after, QString title);
+        AlarmItem *addAlarmItem(int kind, QString text, double limit, double deadband, QString *error);
+        QString arenaReport(void);
+        QModelIndex currentTag(void);
+        HotTagItem *hotItem(QString name, QString source, HotTagItem *parent = nullptr);
+        void removeHotItem(QString name, QString source);
+        void forgetTag(tag_index idx);
+        std::vector<RootTag *> visibleTags(void);
 
     public:
-        explicit MainWindow(QWidget *parent = nullptr);
+        explicit MainWindow(Dax *dax, QWidget *parent = nullptr);
         ~MainWindow();
 
     public slots:
         void connect(void);
+        void newConnection(void);
         void disconnect(void);
+        void connectionLost(void);
+        void reconnect(void);
         void addTagToTree(tag_index idx);
         void delTagFromTree(tag_index idx);
+        void tagsAdded(QList<TagInfo> tags);
+        void tagsDeleted(QList<tag_index> tags);
         void startTagUpdate(void);
         void stopTagUpdate(void);
         void updateTags(void);
+        void pollTags(void);
+        void pollDone(void);
+        void adaptivePolling(bool checked);
+        void treeExpanded(const QModelIndex &index);
+        void treeCollapsed(const QModelIndex &index);
+        void freezeTags(bool checked);
         void updateTime(int msec);
         void aboutDialog(void);
         void treeContextMenu(const QPoint& pos);
         void treeWatchContextMenu(const QPoint& pos);
-        void treeItemChanged(QTreeWidgetItem *current, QTreeWidgetItem *previous);
-        void treeItemActivate(QTreeWidgetItem *item, int column);
+        void treeItemChanged(const QModelIndex &current, const QModelIndex &previous);
+        void treeItemActivate(const QModelIndex &index);
         void editAccept(void);
         void addTag(void);
         void deleteTag(void);
         void addType(void);
         void addToWatchlist(void);
+        void arrayView(void);
+        void updateHotTags(void);
         void delFromWatchlist(void);
+        void saveWatchlist(void);
+        void loadWatchlist(void);
+        void addExpression(void);
+        void watchFilter(void);
+        void recordTrace(bool checked);
+        void addAlarm(void);
+        void deleteAlarm(void);
+        void alarmChanged(int id, bool active, bool firstOut, double value, qint64 since);
+        void treeAlarmContextMenu(const QPoint& pos);
+        void captureSnapshot(void);
+        void openSnapshot(void);
+        void compareSnapshots(void);
+        void compareLive(void);
+        void watchesResolved(void);
+        void watchesSubscribed(void);
 
     signals:
         void operate(void);
@@ -0,0 +1,270 @@
+/*  qDAX - An open source data acquisition and control system
+ *  Copyright (c) 2023 Phil Birkelbach
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+
+ *  Source code file for the headless monitor.  This subscribes to change
+ *  events on the requested tags and writes every change to stdout.  There
+ *  is no Qt here at all so that nothing gets between the events and the
+ *  output.
+ */
+
+#include <chrono>
+#include <csignal>
+#include "qdax.h"
+#include "monitor.h"
+
+/* Size of the stdio buffer for stdout.  We flush it ourselves when things
+   go quiet so that a reader on the other end of a pipe isn't kept waiting. */
+#define MONITOR_OUTBUFF_SIZE 1048576
+#define MONITOR_FLUSH_TIME 100
+
+static volatile sig_atomic_t _quit = 0;
+
+static void
+_signal_handler(int sig) {
+    _quit = 1;
+}
+
+
+/* Simple glob matcher that only understands '*' and '?'.  We don't use the
+   usual shell rules because '[' is part of the tag array syntax. */
+static bool
+_glob_match(const char *pattern, const char *str) {
+    const char *star = NULL;
+    const char *mark = NULL;
+
+    while(*str) {
+        if(*pattern == '?' || *pattern == *str) {
+            pattern++;
+            str++;
+        } else if(*pattern == '*') {
+            star = pattern++;
+            mark = str;
+        } else if(star != NULL) {
+            pattern = star + 1;
+            str = ++mark;
+        } else {
+            return false;
+        }
+    }
+    while(*pattern == '*') pattern++;
+    return *pattern == '\0';
+}
+
+
+static uint64_t
+_timestamp(void) {
+    auto now = std::chrono::system_clock::now().time_since_epoch();
+    return std::chrono::duration_cast<std::chrono::microseconds>(now).count();
+}
+
+
+Monitor::Monitor(Dax *dax, bool binary) {
+    this->dax = dax;
+    _binary = binary;
+    _outbuff = (char *)malloc(MONITOR_OUTBUFF_SIZE);
+    if(_outbuff != NULL) {
+        setvbuf(stdout, _outbuff, _IOFBF, MONITOR_OUTBUFF_SIZE);
+    }
+}
+
+
+Monitor::~Monitor() {
+    for(MonitorPoint *p : _points) {
+        dax->eventDelete(p->event_id);
+        delete p;
+    }
+    fflush(stdout);
+    setvbuf(stdout, NULL, _IOLBF, 0);
+    if(_outbuff != NULL) free(_outbuff);
+}
+
+
+int
+Monitor::_addPoint(std::string name) {
+    MonitorPoint *p;
+    int result;
+
+    p = new MonitorPoint;
+    p->id = _points.size();
+    p->name = name;
+    p->monitor = this;
+    result = dax->getHandle(&p->h, (char *)name.c_str());
+    if(result) {
+        delete p;
+        return result;
+    }
+    result = dax->eventAdd(&p->h, EVENT_CHANGE, NULL, &p->event_id, _change_callback, p, NULL);
+    if(result == ERR_OK) {
+        result = dax->eventOptions(p->event_id, EVENT_OPT_SEND_DATA);
+        if(result) dax->eventDelete(p->event_id);
+    }
+    if(result) {
+        delete p;
+        return result;
+    }
+    if(p->h.size > _buffer.size()) _buffer.resize(p->h.size);
+    _points.push_back(p);
+    return ERR_OK;
+}
+
+
+/* Walks the whole tag list and adds every tag whose name matches */
+int
+Monitor::_findTags(std::string pattern) {
+    tag_index lastindex;
+    tag_handle h;
+    dax_tag tag;
+    int result, count = 0;
+
+    result = dax->getHandle(&h, (char *)"_lastindex");
+    if(result) return result;
+    result = dax->read(h, &lastindex);
+    if(result) return result;
+
+    for(tag_index n = 0; n<=lastindex; n++) {
+        if(dax->getTag(&tag, n)) continue;
+        if(tag.name[0] == '_') continue; /* Skip the server's own tags */
+        if(!_glob_match(pattern.c_str(), tag.name)) continue;
+        result = _addPoint(tag.name);
+        if(result) {
+            dax_log(DAX_LOG_ERROR, "Unable to monitor %s - %s", tag.name, dax_errstr(result));
+        } else {
+            count++;
+        }
+    }
+    return count ? ERR_OK : ERR_NOTFOUND;
+}
+
+
+/* A pattern without any wildcards is passed straight to the server so that
+   members and array elements can be given as well as whole tags. */
+int
+Monitor::addPattern(std::string pattern) {
+    if(pattern.find_first_of("*?") == std::string::npos) {
+        return _addPoint(pattern);
+    }
+    return _findTags(pattern);
+}
+
+
+void
+Monitor::_writeHeader(void) {
+    uint32_t u;
+
+    fwrite(MONITOR_MAGIC, 1, 4, stdout);
+    u = MONITOR_VERSION;     fwrite(&u, sizeof(u), 1, stdout);
+    u = _points.size();      fwrite(&u, sizeof(u), 1, stdout);
+    for(MonitorPoint *p : _points) {
+        fwrite(&p->id, sizeof(uint32_t), 1, stdout);
+        u = p->h.type;       fwrite(&u, sizeof(u), 1, stdout);
+        u = p->h.count;      fwrite(&u, sizeof(u), 1, stdout);
+        u = p->h.bit;        fwrite(&u, sizeof(u), 1, stdout);
+        u = p->name.size();  fwrite(&u, sizeof(u), 1, stdout);
+        fwrite(p->name.c_str(), 1, p->name.size(), stdout);
+    }
+}
+
+
+void
+Monitor::_writeBinary(MonitorPoint *p, uint64_t timestamp) {
+    uint32_t u;
+
+    fwrite(&timestamp, sizeof(timestamp), 1, stdout);
+    fwrite(&p->id, sizeof(uint32_t), 1, stdout);
+    u = p->h.size;
+    fwrite(&u, sizeof(u), 1, stdout);
+    fwrite(_buffer.data(), 1, p->h.size, stdout);
+}
+
+
+/* Text lines are "seconds.microseconds name value".  Array elements are
+   separated by commas and CHAR arrays are written as a string.  We don't
+   know how to print compound types so each element of those is written
+   as the hex of its bytes. */
+void
+Monitor::_writeText(MonitorPoint *p, uint64_t timestamp) {
+    uint8_t *data = _buffer.data();
+    uint32_t bit, size;
+
+    fprintf(stdout, "%llu.%06llu %s ", (unsigned long long)(timestamp / 1000000),
+                                       (unsigned long long)(timestamp % 1000000),
+                                       p->name.c_str());
+    if(p->h.type == DAX_CHAR && p->h.count > 1) {
+        fwrite(data, 1, strnlen((char *)data, p->h.count), stdout);
+    } else {
+        for(uint32_t n=0; n<p->h.count; n++) {
+            if(n) fputc(',', stdout);
+            if(p->h.type == DAX_BOOL) {
+                bit = p->h.bit + n;
+                fputs(data[bit / 8] & (0x01 << (bit % 8)) ? "true" : "false", stdout);
+            } else if(IS_CUSTOM(p->h.type)) {
+                size = p->h.size / p->h.count;
+                for(uint32_t i=0; i<size; i++) fprintf(stdout, "%02x", data[n * size + i]);
+            } else {
+                fputs(dax->valueString(p->h.type, data, n).c_str(), stdout);
+            }
+        }
+    }
+    fputc('\n', stdout);
+}
+
+
+void
+Monitor::_change_callback(Dax *d, void *udata) {
+    MonitorPoint *p = (MonitorPoint *)udata;
+    Monitor *m = p->monitor;
+
+    if(d->eventGetData(m->_buffer.data(), p->h.size) < 0) return;
+    if(m->_binary) {
+        m->_writeBinary(p, _timestamp());
+    } else {
+        m->_writeText(p, _timestamp());
+    }
+}
+
+
+/* Dispatch events until we are interrupted or lose the server */
+int
+Monitor::run(void) {
+    uint64_t lastflush;
+    dax_id id;
+    int result;
+
+    if(_points.size() == 0) {
+        dax_log(DAX_LOG_ERROR, "Nothing to monitor");
+        return 1;
+    }
+    signal(SIGINT, _signal_handler);
+    signal(SIGTERM, _signal_handler);
+    if(_binary) _writeHeader();
+    fflush(stdout);
+
+    lastflush = _timestamp();
+    while(!_quit) {
+        result = dax->eventWait(MONITOR_FLUSH_TIME, &id);
+        if(Dax::connectionError(result)) {
+            dax_log(DAX_LOG_ERROR, "Lost connection to the tag server");
+            return 1;
+        }
+        if(_timestamp() - lastflush > MONITOR_FLUSH_TIME * 1000) {
+            fflush(stdout);
+            lastflush = _timestamp();
+        }
+    }
+    return 0;
+}
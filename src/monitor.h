@@ -0,0 +1,87 @@
+/*  qDAX - An open source data acquisition and control system
+ *  Copyright (c) 2023 Phil Birkelbach
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+
+ *  Header file for the headless monitor that streams tag changes to stdout
+ */
+
+#ifndef MONITOR_H
+#define MONITOR_H
+
+#include <vector>
+#include <string>
+#include "dax.h"
+
+/* Binary output stream format.  All integers are little endian as written
+   by the host.  The stream starts with a header...
+
+     char[4]  "QDXM"
+     uint32   version
+     uint32   number of points
+     then for each point
+       uint32  point id
+       uint32  data type
+       uint32  count
+       uint32  bit offset of the first value in the data, only BOOL's
+               can be anything but 0
+       uint32  name length
+       char[]  name (not terminated)
+
+   ...followed by one record per change...
+
+     uint64   timestamp in microseconds since the epoch
+     uint32   point id
+     uint32   data length
+     uint8[]  raw data as the server sent it
+*/
+#define MONITOR_MAGIC "QDXM"
+#define MONITOR_VERSION 2
+
+class Monitor;
+
+struct MonitorPoint {
+    uint32_t id;
+    std::string name;
+    tag_handle h;
+    dax_id event_id;
+    Monitor *monitor;
+};
+
+class Monitor
+{
+    private:
+        Dax *dax;
+        bool _binary;
+        std::vector<MonitorPoint *> _points;
+        std::vector<uint8_t> _buffer;
+        char *_outbuff;
+
+        static void _change_callback(Dax *d, void *udata);
+        int _addPoint(std::string name);
+        int _findTags(std::string pattern);
+        void _writeHeader(void);
+        void _writeText(MonitorPoint *p, uint64_t timestamp);
+        void _writeBinary(MonitorPoint *p, uint64_t timestamp);
+
+    public:
+        Monitor(Dax *dax, bool binary);
+        ~Monitor();
+        int addPattern(std::string pattern);
+        int run(void);
+};
+
+#endif
@@ -0,0 +1,231 @@
+/*  qDAX - An open source data acquisition and control system
+ *  Copyright (c) 2023 Phil Birkelbach
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+
+ *  Source code file for the tag tree refresh scheduler
+ */
+
+#include <algorithm>
+#include <cstring>
+#include "qdax.h"
+#include "scheduler.h"
+#include "trace.h"
+
+
+TagScheduler::TagScheduler(Dax *dax, TagModel *model, ValueCache *cache) {
+    this->dax = dax;
+    _model = model;
+    _cache = cache;
+    _adaptive = false;
+    _base = 1000;
+    _max = 1000;
+    _skipped = 0;
+    clear();
+}
+
+
+/* Forgets the expanded tags and starts the tiers over.  This is for when
+   the tags in the model are reloaded. */
+void
+TagScheduler::clear(void) {
+    _expanded.clear();
+    _polled.clear();
+    _plan.clear();
+    for(int n=0;n<SCHEDULE_TIERS;n++) _cursor[n] = _planEnd[n] = 0;
+}
+
+
+/* base is the timer interval.  In adaptive mode the interval of a tag that
+   isn't changing doubles on each read, up to max. */
+void
+TagScheduler::setIntervals(bool adaptive, int base, int max) {
+    _adaptive = adaptive;
+    _base = base;
+    _max = std::max(base, max);
+}
+
+
+/* Plans the reads for one tier, starting at the cursor, until we've been
+   around once or the plan is full.  Tags that were already read on this
+   tick, or that aren't due yet, are passed over.  Half a tick of slack
+   keeps timer jitter from costing a tag a whole tick.  The cursor isn't
+   moved until apply() knows how far the poll thread got. */
+template<typename F>
+void
+TagScheduler::_planTier(int tier, size_t size, F get, qint64 now) {
+    RootTag *r;
+    PollRead p;
+    size_t n;
+
+    n = size ? _cursor[tier] % size : 0;
+    for(size_t i=0;i<size;i++, n = (n + 1) % size) {
+        if(_plan.size() >= SCHEDULE_PLAN_LIMIT) break;
+        r = get(n);
+        if(r == nullptr || r->paged || r->lastRead == now || r->considered == now) continue;
+        /* A tag can be in more than one tier so it's only counted once */
+        r->considered = now;
+        if(r->nextPoll > now + _base / 2) {
+            if(_adaptive) _skipped++;
+            continue;
+        }
+        p.h = r->h;
+        p.tier = tier;
+        p.pos = n;
+        /* Our own last read is at least a tick old so it won't pass here.
+           The version keeps us from copying what we already have. */
+        p.cached = _cache->fetch(r->h, r->data, now, _base / 2, &r->version);
+        if(p.cached) _skipped++;
+        _plan.push_back(p);
+    }
+    _planEnd[tier] = n;
+}
+
+
+/* Plans as much as one tick can read.  visible is the tags that have rows
+   on the screen. */
+const std::vector<PollRead> &
+TagScheduler::plan(const std::vector<RootTag *> &visible, qint64 now) {
+    std::vector<RootTag *> expanded;
+    RootTag *r;
+    TraceScope span("TagScheduler::plan");
+
+    _polled.clear();
+    _plan.clear();
+    _planTier(TIER_VISIBLE, visible.size(), [&](size_t n) { return visible[n]; }, now);
+
+    for(tag_index idx : _expanded) {
+        r = _model->rootTag(idx);
+        if(r) expanded.push_back(r);
+    }
+    /* The set has no order of it's own so the tags go around in row order */
+    std::sort(expanded.begin(), expanded.end(), [](RootTag *a, RootTag *b) { return a->row < b->row; });
+    _planTier(TIER_EXPANDED, expanded.size(), [&](size_t n) { return expanded[n]; }, now);
+
+    _planTier(TIER_OTHER, _model->rootCount(), [&](size_t n) { return _model->root(n); }, now);
+    return _plan;
+}
+
+
+/* Takes the results of the plan from the poll thread.  done is how many of
+   the reads it got to.  The tags are looked up again because the model may
+   have changed while the thread was reading, and a tag that's different
+   now is left alone.  Each tier's cursor goes to the first read that
+   wasn't done so that it's first in line next time. */
+void
+TagScheduler::apply(const std::vector<uint8_t> &data, const std::vector<int> &status, size_t done, qint64 now) {
+    bool moved[SCHEDULE_TIERS] = {false};
+    size_t offset = 0;
+    RootTag *r;
+
+    for(size_t n=0;n<_plan.size();n++) {
+        const PollRead &p = _plan[n];
+        if(n >= done || n >= status.size()) {
+            if(!moved[p.tier]) _cursor[p.tier] = p.pos;
+            moved[p.tier] = true;
+            continue;
+        }
+        r = _model->rootTag(p.h.index);
+        if(!p.cached) offset += p.h.size;
+        if(r == nullptr || r->paged || r->lastRead == now) continue;
+        if(r->h.byte != p.h.byte || r->h.size != p.h.size || r->h.type != p.h.type) continue;
+        if(!p.cached && status[n] == ERR_OK) {
+            memcpy(r->data, &data[offset - p.h.size], p.h.size);
+            r->version = _cache->update(r->h, r->data, now);
+        }
+        r->lastRead = now;
+        _polled.push_back(r);
+    }
+    for(int n=0;n<SCHEDULE_TIERS;n++) {
+        if(!moved[n]) _cursor[n] = _planEnd[n];
+    }
+    _plan.clear();
+}
+
+
+/* Sets when the tags that were just read are due again.  This has to be
+   after the model has looked at the new data so that we know which ones
+   changed. */
+void
+TagScheduler::finish(qint64 now) {
+    for(RootTag *r : _polled) {
+        if(!_adaptive || r->activity.last == now || r->pollInterval == 0) r->pollInterval = _base;
+        else r->pollInterval = std::min(_max, r->pollInterval * 2);
+        r->nextPoll = now + r->pollInterval;
+    }
+    _polled.clear();
+}
+
+
+/* Reads that adaptive polling or the cache have saved since the last call */
+uint64_t
+TagScheduler::takeSkipped(void) {
+    uint64_t skipped = _skipped;
+
+    _skipped = 0;
+    return skipped;
+}
+
+
+PollWorker::PollWorker(Dax *dax) {
+    this->dax = dax;
+    _done = 0;
+    _result = ERR_OK;
+    _budget = SCHEDULE_BUDGET;
+}
+
+
+void
+PollWorker::setPlan(const std::vector<PollRead> &plan, int budget) {
+    _plan = plan;
+    _budget = budget;
+}
+
+
+/* The data for all of the reads goes in one buffer, one after the other in
+   the order of the plan.  A connection error stops everything and is left
+   in result() for the GUI to deal with. */
+void
+PollWorker::read(void) {
+    QElapsedTimer time;
+    size_t size = 0;
+    size_t offset = 0;
+    int result;
+    TraceScope span("PollWorker::read");
+
+    for(const PollRead &p : _plan) {
+        if(!p.cached) size += p.h.size;
+    }
+    _data.resize(size);
+    _status.assign(_plan.size(), ERR_OK);
+    _result = ERR_OK;
+    _done = 0;
+    time.start();
+    for(const PollRead &p : _plan) {
+        if(time.elapsed() >= _budget) break;
+        if(!p.cached) {
+            result = dax->read(p.h, &_data[offset]);
+            if(Dax::connectionError(result)) {
+                _result = result;
+                break;
+            }
+            _status[_done] = result;
+            offset += p.h.size;
+        }
+        _done++;
+    }
+    emit done();
+}
@@ -0,0 +1,130 @@
+/*  qDAX - An open source data acquisition and control system
+ *  Copyright (c) 2023 Phil Birkelbach
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+
+ *  Header file for the tag tree refresh scheduler
+ */
+
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+#include <QObject>
+#include <QSet>
+#include <QElapsedTimer>
+#include <vector>
+#include "dax.h"
+#include "tagmodel.h"
+#include "valuecache.h"
+
+/* Milliseconds of reading that one tick of the tag timer is allowed */
+#define SCHEDULE_BUDGET 25
+
+#define TIER_VISIBLE 0
+#define TIER_EXPANDED 1
+#define TIER_OTHER 2
+#define SCHEDULE_TIERS 3
+
+/* Most reads that are planned for one tick.  What the poll thread doesn't
+   get to is planned again on the next one. */
+#define SCHEDULE_PLAN_LIMIT 4096
+
+/* A read that the scheduler wants done on the poll thread.  The handle is
+   a copy so that the thread never looks at the model.  A tag that came
+   from the value cache is still in the plan so that it's kept in order,
+   but the thread passes over it. */
+struct PollRead {
+    tag_handle h;
+    int tier;
+    size_t pos;     /* Where the tag is in it's tier */
+    bool cached;
+};
+
+/* Decides which tags are read on each tick of the tag timer.  The tags
+   on the screen go first, then the ones that are expanded in the tree and
+   then everything else.  Each tier is round robin and starts where it
+   left off, so when the budget runs out the rest of the work is carried
+   into the next tick.  A tag that the value cache already has a fresh
+   copy of, from a watch event say, isn't read at all.
+
+   The scheduler belongs to the GUI thread.  plan() works out the reads,
+   a PollWorker does them on the connection's poll thread and apply()
+   puts what it got into the model. */
+class TagScheduler
+{
+    private:
+        Dax *dax;
+        TagModel *_model;
+        ValueCache *_cache;
+        QSet<tag_index> _expanded;
+        size_t _cursor[SCHEDULE_TIERS];
+        size_t _planEnd[SCHEDULE_TIERS];
+        std::vector<PollRead> _plan;
+        std::vector<RootTag *> _polled;
+        bool _adaptive;
+        int _base;
+        int _max;
+        uint64_t _skipped;
+
+        template<typename F>
+        void _planTier(int tier, size_t size, F get, qint64 now);
+
+    public:
+        TagScheduler(Dax *dax, TagModel *model, ValueCache *cache);
+
+        void expanded(tag_index idx) { _expanded.insert(idx); };
+        void collapsed(tag_index idx) { _expanded.remove(idx); };
+        void clear(void);
+        void setIntervals(bool adaptive, int base, int max);
+        const std::vector<PollRead> &plan(const std::vector<RootTag *> &visible, qint64 now);
+        void apply(const std::vector<uint8_t> &data, const std::vector<int> &status, size_t done, qint64 now);
+        void finish(qint64 now);
+        const std::vector<RootTag *> &polled(void) { return _polled; };
+        uint64_t takeSkipped(void);
+};
+
+/* Does the reads of a plan on the poll thread, in order, until the budget
+   is gone.  Like the WatchLoader the GUI doesn't touch it between read()
+   and done(), and the results are left here for it to pick up. */
+class PollWorker : public QObject
+{
+    Q_OBJECT
+
+    private:
+        Dax *dax;
+        std::vector<PollRead> _plan;
+        std::vector<uint8_t> _data;
+        std::vector<int> _status;
+        size_t _done;
+        int _result;
+        int _budget;
+
+    public slots:
+        void read(void);
+
+    signals:
+        void done(void);
+
+    public:
+        PollWorker(Dax *dax);
+        void setPlan(const std::vector<PollRead> &plan, int budget);
+        const std::vector<uint8_t> &data(void) { return _data; };
+        const std::vector<int> &status(void) { return _status; };
+        size_t count(void) { return _done; };
+        int result(void) { return _result; };
+};
+
+#endif
@@ -0,0 +1,438 @@
+/*  qDAX - An open source data acquisition and control system
+ *  Copyright (c) 2023 Phil Birkelbach
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+
+ *  Source code file for the full server snapshots and the diff between them
+ */
+
+#include <cstring>
+#include <atomic>
+#include <algorithm>
+#include <QThread>
+#include <QSaveFile>
+#include <QDateTime>
+#include "qdax.h"
+#include "snapshot.h"
+
+
+Snapshot::Snapshot() {
+    _data = nullptr;
+    _map = nullptr;
+    _time = 0;
+    _errors = 0;
+}
+
+
+Snapshot::~Snapshot() {
+    if(_map) _file.unmap(_map);
+}
+
+
+uint32_t
+Snapshot::_string(QString s) {
+    auto it = _stringIds.find(s);
+
+    if(it != _stringIds.end()) return it.value();
+    _strings.push_back(s);
+    _stringIds.insert(s, _strings.size() - 1);
+    return _strings.size() - 1;
+}
+
+
+/* Copies the layout of a type, and the types inside of it, out of the
+   model.  The model only knows the types of the tags that it has built
+   nodes for so this asks the server for the rest. */
+void
+Snapshot::_layout(TagModel *model, tag_type type, QString instance, uint32_t bitoffset) {
+    const std::vector<TypeMember> *layout;
+    std::vector<TypeMember> copy;
+    TypeMember c;
+
+    if(_layouts.count(type)) return;
+    layout = model->_layout(type, instance, bitoffset);
+    for(const TypeMember &m : *layout) {
+        c = m;
+        c.name = _string(model->_names[m.name]);
+        copy.push_back(c);
+    }
+    _layouts[type] = copy;
+    for(const TypeMember &m : copy) {
+        if(IS_CUSTOM(m.type)) {
+            _layout(model, m.type, instance + "." + _strings[m.name] + (m.count > 1 ? "[0]" : ""),
+                    bitoffset + m.bitoffset);
+        }
+    }
+}
+
+
+/* Works out where each tag's data is and the lookup by name */
+void
+Snapshot::_index(void) {
+    uint64_t offset = 0;
+
+    _offsets.clear();
+    _byName.clear();
+    for(size_t n=0;n<_tags.size();n++) {
+        _offsets.push_back(offset);
+        offset += _tags[n].h.size;
+        _byName.insert(_strings[_tags[n].name], n);
+    }
+    _offsets.push_back(offset);
+}
+
+
+const std::vector<TypeMember> *
+Snapshot::layout(tag_type type) const {
+    auto it = _layouts.find(type);
+
+    if(it == _layouts.end()) return nullptr;
+    return &it->second;
+}
+
+
+/* Reads every tag that the model knows about.  The tags are split into
+   runs of about the same number of bytes and each run is read by a thread
+   with it's own connection to the server. */
+int
+Snapshot::capture(Dax *dax, TagModel *model, int threads) {
+    std::vector<Dax *> connections;
+    std::vector<size_t> bounds;
+    std::atomic<uint32_t> errors(0);
+    std::atomic<int> failed(ERR_OK);
+    QList<QThread *> workers;
+    CacheTag ct;
+    RootTag *r;
+    QString name;
+    uint64_t total;
+    int result;
+
+    _tags.clear();
+    _layouts.clear();
+    _time = QDateTime::currentMSecsSinceEpoch();
+    for(int n=0;n<model->rootCount();n++) {
+        r = model->root(n);
+        name = model->_names[model->_name[r->node]];
+        memset(&ct, 0, sizeof(ct));
+        ct.h = r->h;
+        ct.idx = r->idx;
+        ct.type = model->_type[r->node];
+        ct.count = model->_count[r->node];
+        ct.attr = r->readonly ? TAG_ATTR_READONLY : 0;
+        ct.name = _string(name);
+        ct.typeName = _string(r->typeName);
+        _tags.push_back(ct);
+        if(IS_CUSTOM(ct.type)) _layout(model, ct.type, name + (ct.count > 1 ? "[0]" : ""), 0);
+    }
+    _index();
+    total = size();
+    _buffer.assign(total, 0);
+    _data = _buffer.data();
+
+    threads = std::max(1, std::min(threads, SNAPSHOT_MAX_THREADS));
+    bounds.push_back(0);
+    for(int k=1;k<threads;k++) {
+        bounds.push_back(std::lower_bound(_offsets.begin(), _offsets.end() - 1, total * k / threads) - _offsets.begin());
+    }
+    bounds.push_back(_tags.size());
+
+    /* Configuring a connection isn't thread safe so that's done here */
+    for(int k=0;k<threads;k++) {
+        connections.push_back(dax->duplicate("qdax-snapshot"));
+    }
+    for(int k=0;k<threads;k++) {
+        Dax *d = connections[k];
+        size_t lo = bounds[k], hi = bounds[k + 1];
+        workers.append(QThread::create([this, d, lo, hi, &errors, &failed]() {
+            int result = d->connect();
+            if(result) {
+                failed = result;
+                return;
+            }
+            for(size_t n=lo;n<hi;n++) {
+                if(_tags[n].h.size == 0) continue;
+                if(d->read(_tags[n].h, _buffer.data() + _offsets[n])) errors++;
+            }
+            d->disconnect();
+        }));
+        workers.last()->start();
+    }
+    for(QThread *t : workers) {
+        t->wait();
+        delete t;
+    }
+    for(Dax *d : connections) delete d;
+    _errors = errors;
+    result = failed;
+    return result;
+}
+
+
+int
+Snapshot::save(QString path) {
+    std::vector<uint32_t> offsets;
+    std::vector<CacheTag> tags;
+    std::vector<CacheType> types;
+    std::vector<TypeMember> members;
+    QByteArray strings;
+    SnapshotHeader hdr;
+    CacheType t;
+    qint64 pos;
+
+    for(const QString &s : _strings) {
+        offsets.push_back(strings.size());
+        strings.append(s.toUtf8());
+        strings.append('\0');
+    }
+    if(strings.isEmpty()) strings.append('\0');
+    for(CacheTag ct : _tags) {
+        ct.name = offsets[ct.name];
+        ct.typeName = offsets[ct.typeName];
+        tags.push_back(ct);
+    }
+    for(auto &it : _layouts) {
+        t.type = it.first;
+        t.first = members.size();
+        t.count = it.second.size();
+        for(TypeMember m : it.second) {
+            m.name = offsets[m.name];
+            members.push_back(m);
+        }
+        types.push_back(t);
+    }
+
+    memset(&hdr, 0, sizeof(hdr));
+    memcpy(hdr.magic, SNAPSHOT_MAGIC, 4);
+    hdr.version = SNAPSHOT_VERSION;
+    hdr.handleSize = sizeof(tag_handle);
+    hdr.tags = tags.size();
+    hdr.types = types.size();
+    hdr.members = members.size();
+    hdr.strings = strings.size();
+    hdr.errors = _errors;
+    hdr.time = _time;
+    hdr.size = size();
+
+    QSaveFile file(path);
+    if(!file.open(QIODevice::WriteOnly)) return ERR_NOTFOUND;
+    file.write((const char *)&hdr, sizeof(hdr));
+    file.write((const char *)tags.data(), tags.size() * sizeof(CacheTag));
+    file.write((const char *)types.data(), types.size() * sizeof(CacheType));
+    file.write((const char *)members.data(), members.size() * sizeof(TypeMember));
+    file.write(strings);
+    pos = file.pos();
+    while(pos % 8) {
+        file.putChar('\0');
+        pos++;
+    }
+    file.write((const char *)_data, hdr.size);
+    if(!file.commit()) return ERR_NOTFOUND;
+    return ERR_OK;
+}
+
+
+/* Maps the file and leaves it mapped.  The data is used where it is */
+int
+Snapshot::load(QString path) {
+    const SnapshotHeader *hdr;
+    const CacheTag *tags;
+    const CacheType *types;
+    const TypeMember *members;
+    const char *strings;
+    std::vector<TypeMember> layout;
+    qint64 size, meta;
+    CacheTag ct;
+
+    _file.setFileName(path);
+    if(!_file.open(QIODevice::ReadOnly)) return ERR_NOTFOUND;
+    size = _file.size();
+    if(size < (qint64)sizeof(SnapshotHeader)) return ERR_ARG;
+    _map = _file.map(0, size);
+    if(_map == nullptr) return ERR_NOTFOUND;
+
+    hdr = (const SnapshotHeader *)_map;
+    meta = sizeof(SnapshotHeader) + (qint64)hdr->tags * sizeof(CacheTag) + (qint64)hdr->types * sizeof(CacheType) +
+           (qint64)hdr->members * sizeof(TypeMember) + hdr->strings;
+    meta = (meta + 7) & ~7;
+    if(memcmp(hdr->magic, SNAPSHOT_MAGIC, 4) || hdr->version != SNAPSHOT_VERSION ||
+       hdr->handleSize != sizeof(tag_handle) || hdr->strings == 0 || meta + (qint64)hdr->size != size) {
+        return ERR_ARG;
+    }
+    tags = (const CacheTag *)(_map + sizeof(SnapshotHeader));
+    types = (const CacheType *)(tags + hdr->tags);
+    members = (const TypeMember *)(types + hdr->types);
+    strings = (const char *)(members + hdr->members);
+    if(strings[hdr->strings - 1] != '\0') return ERR_ARG;
+
+    for(uint32_t n=0;n<hdr->types;n++) {
+        if(types[n].first > hdr->members || types[n].count > hdr->members - types[n].first) return ERR_ARG;
+        layout.clear();
+        for(uint32_t i=0;i<types[n].count;i++) {
+            TypeMember m = members[types[n].first + i];
+            if(m.name >= hdr->strings) return ERR_ARG;
+            m.name = _string(QString(&strings[m.name]));
+            layout.push_back(m);
+        }
+        _layouts[types[n].type] = layout;
+    }
+    for(uint32_t n=0;n<hdr->tags;n++) {
+        ct = tags[n];
+        if(ct.name >= hdr->strings || ct.typeName >= hdr->strings) return ERR_ARG;
+        ct.name = _string(QString(&strings[ct.name]));
+        ct.typeName = _string(QString(&strings[ct.typeName]));
+        _tags.push_back(ct);
+    }
+    _index();
+    if(this->size() != hdr->size) return ERR_ARG;
+    _data = _map + meta;
+    _time = hdr->time;
+    _errors = hdr->errors;
+    return ERR_OK;
+}
+
+
+QString
+Snapshot::leafString(Dax *dax, const uint8_t *data, tag_type type, uint64_t bit) {
+    if(type == DAX_BOOL) {
+        return (data[bit / 8] >> (bit % 8)) & 0x01 ? "true" : "false";
+    }
+    return QString(dax->valueString(type, (void *)(data + bit / 8), 0).c_str());
+}
+
+
+/* Walks down to the leaves that are different.  Each level is compared as
+   a block first so that the parts that are the same are skipped at memcmp
+   speed. */
+void
+Snapshot::_diffNode(const uint8_t *a, const uint8_t *b, tag_type type,
+                    uint32_t count, uint64_t bit, uint32_t elembits, QString name,
+                    std::vector<SnapshotChange> *out, uint64_t *total, Dax *dax) const {
+    const std::vector<TypeMember> *layout;
+    uint64_t bits = (uint64_t)count * elembits;
+    uint64_t eb;
+
+    if(bit % 8 == 0 && bits % 8 == 0 && memcmp(a + bit / 8, b + bit / 8, bits / 8) == 0) return;
+    /* A single BOOL is smaller than a byte so the memcmp() can't see it */
+    if(type == DAX_BOOL && count == 1 && (((a[bit / 8] ^ b[bit / 8]) >> (bit % 8)) & 0x01) == 0) return;
+    if(count > 1) {
+        for(uint32_t i=0;i<count;i++) {
+            eb = bit + (uint64_t)i * elembits;
+            if(type == DAX_BOOL) {
+                if((((a[eb / 8] ^ b[eb / 8]) >> (eb % 8)) & 0x01) == 0) continue;
+            } else if(memcmp(a + eb / 8, b + eb / 8, elembits / 8) == 0) {
+                continue;
+            }
+            _diffNode(a, b, type, 1, eb, elembits, name + "[" + QString::number(i) + "]", out, total, dax);
+        }
+        return;
+    }
+    if(IS_CUSTOM(type)) {
+        layout = this->layout(type);
+        if(layout != nullptr) {
+            for(const TypeMember &m : *layout) {
+                _diffNode(a, b, m.type, m.count, bit + m.bitoffset, m.elembits,
+                          name + "." + _strings[m.name], out, total, dax);
+            }
+            return;
+        }
+    }
+    (*total)++;
+    if(out->size() >= SNAPSHOT_DIFF_LIMIT) return;
+    if(IS_CUSTOM(type)) out->push_back({name, "<changed>", "<changed>"});
+    else                out->push_back({name, leafString(dax, a, type, bit), leafString(dax, b, type, bit)});
+}
+
+
+/* Compares two snapshots and returns the number of changes.  Tags are
+   matched up by name since the indexes and the type numbers can be
+   different if the server was restarted in between.  The tags are split up
+   between threads by size and the changes are put back together in
+   order. */
+uint64_t
+Snapshot::diff(const Snapshot *before, const Snapshot *after, Dax *dax,
+               std::vector<SnapshotChange> *out, int threads) {
+    std::vector<std::pair<int, int>> pairs;
+    std::vector<uint64_t> sizes;
+    std::vector<size_t> bounds;
+    std::vector<std::vector<SnapshotChange>> results;
+    std::vector<uint64_t> totals;
+    QList<QThread *> workers;
+    uint64_t total = 0, bytes = 0;
+    QString name;
+    int i;
+
+    for(int n=0;n<before->tagCount();n++) {
+        name = before->_strings[before->_tags[n].name];
+        if(!after->_byName.contains(name)) {
+            out->push_back({name, before->_strings[before->_tags[n].typeName], "<deleted>"});
+            total++;
+        }
+    }
+    for(int n=0;n<after->tagCount();n++) {
+        const CacheTag &t = after->_tags[n];
+        name = after->_strings[t.name];
+        i = before->_byName.value(name, -1);
+        if(i < 0) {
+            out->push_back({name, "<added>", after->_strings[t.typeName]});
+            total++;
+            continue;
+        }
+        const CacheTag &s = before->_tags[i];
+        if(before->_strings[s.typeName] != after->_strings[t.typeName] || s.h.size != t.h.size) {
+            out->push_back({name, before->_strings[s.typeName], after->_strings[t.typeName]});
+            total++;
+            continue;
+        }
+        pairs.push_back({i, n});
+        bytes += s.h.size;
+        sizes.push_back(bytes);
+    }
+
+    threads = std::max(1, std::min(threads, SNAPSHOT_MAX_THREADS));
+    bounds.push_back(0);
+    for(int k=1;k<threads;k++) {
+        bounds.push_back(std::lower_bound(sizes.begin(), sizes.end(), bytes * k / threads) - sizes.begin());
+    }
+    bounds.push_back(pairs.size());
+    results.resize(threads);
+    totals.assign(threads, 0);
+
+    for(int k=0;k<threads;k++) {
+        size_t lo = bounds[k], hi = bounds[k + 1];
+        workers.append(QThread::create([before, after, dax, &pairs, &results, &totals, k, lo, hi]() {
+            for(size_t p=lo;p<hi;p++) {
+                const CacheTag &s = before->_tags[pairs[p].first];
+                uint32_t elembits = s.type == DAX_BOOL ? 1 : s.h.size * 8 / std::max<uint32_t>(s.h.count, 1);
+                before->_diffNode(before->data(pairs[p].first), after->data(pairs[p].second),
+                                  s.type, s.count, 0, elembits, before->_strings[s.name],
+                                  &results[k], &totals[k], dax);
+            }
+        }));
+        workers.last()->start();
+    }
+    for(QThread *t : workers) {
+        t->wait();
+        delete t;
+    }
+    for(int k=0;k<threads;k++) {
+        total += totals[k];
+        for(SnapshotChange &c : results[k]) {
+            if(out->size() >= SNAPSHOT_DIFF_LIMIT) break;
+            out->push_back(std::move(c));
+        }
+    }
+    return total;
+}
@@ -0,0 +1,113 @@
+/*  qDAX - An open source data acquisition and control system
+ *  Copyright (c) 2023 Phil Birkelbach
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+
+ *  Header file for the full server snapshots and the diff between them
+ */
+
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <QString>
+#include <QFile>
+#include <QHash>
+#include <vector>
+#include <unordered_map>
+#include "dax.h"
+#include "tagmodel.h"
+#include "tagcache.h"
+
+#define SNAPSHOT_MAGIC "QDXS"
+#define SNAPSHOT_VERSION 1
+
+/* Most connections that a capture or a diff will use at once */
+#define SNAPSHOT_MAX_THREADS 8
+
+/* A diff stops keeping the changes after this many but still counts them */
+#define SNAPSHOT_DIFF_LIMIT 100000
+
+/* The file is the header, the tag records, the type records, the member
+   records and the string table all just like the tag cache.  Then the data
+   of every tag one after the other in the order of the tag records,
+   starting on an 8 byte boundary. */
+struct SnapshotHeader {
+    char magic[4];
+    uint32_t version;
+    uint32_t handleSize;
+    uint32_t tags;
+    uint32_t types;
+    uint32_t members;
+    uint32_t strings;
+    uint32_t errors;     /* Tags that we couldn't read */
+    int64_t time;
+    uint64_t size;       /* Of the data */
+};
+
+struct SnapshotChange {
+    QString name;
+    QString before;
+    QString after;
+};
+
+/* A copy of every tag on the server at one point in time.  One that is
+   loaded from a file is used straight out of the memory map so the viewer
+   and the diff don't need a connection. */
+class Snapshot
+{
+    private:
+        std::vector<CacheTag> _tags;
+        std::vector<uint64_t> _offsets;
+        std::unordered_map<tag_type, std::vector<TypeMember>> _layouts;
+        std::vector<QString> _strings;
+        QHash<QString, uint32_t> _stringIds;
+        QHash<QString, int> _byName;
+        std::vector<uint8_t> _buffer;
+        const uint8_t *_data;
+        QFile _file;
+        uchar *_map;
+        int64_t _time;
+        uint32_t _errors;
+
+        uint32_t _string(QString s);
+        void _layout(TagModel *model, tag_type type, QString instance, uint32_t bitoffset);
+        void _index(void);
+        void _diffNode(const uint8_t *a, const uint8_t *b, tag_type type,
+                       uint32_t count, uint64_t bit, uint32_t elembits, QString name,
+                       std::vector<SnapshotChange> *out, uint64_t *total, Dax *dax) const;
+
+    public:
+        Snapshot();
+        ~Snapshot();
+
+        int capture(Dax *dax, TagModel *model, int threads);
+        int save(QString path);
+        int load(QString path);
+        static uint64_t diff(const Snapshot *before, const Snapshot *after, Dax *dax,
+                             std::vector<SnapshotChange> *out, int threads);
+
+        int64_t time(void) const { return _time; };
+        uint32_t errors(void) const { return _errors; };
+        uint64_t size(void) const { return _offsets.empty() ? 0 : _offsets.back(); };
+        int tagCount(void) const { return _tags.size(); };
+        const CacheTag &tag(int n) const { return _tags[n]; };
+        QString string(uint32_t id) const { return id < _strings.size() ? _strings[id] : QString(); };
+        const uint8_t *data(int n) const { return _data + _offsets[n]; };
+        const std::vector<TypeMember> *layout(tag_type type) const;
+        static QString leafString(Dax *dax, const uint8_t *data, tag_type type, uint64_t bit);
+};
+
+#endif
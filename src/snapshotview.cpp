@@ -0,0 +1,129 @@
+/*  qDAX - An open source data acquisition and control system
+ *  Copyright (c) 2023 Phil Birkelbach
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+
+ *  Source code file for the dialog that shows a snapshot or a diff
+ */
+
+#include <QHeaderView>
+#include <QDateTime>
+#include "qdax.h"
+#include "tagmodel.h"
+#include "snapshotview.h"
+
+
+/* Shows the tags in a snapshot.  The view owns the snapshot and since
+   everything comes out of the snapshot it works without a connection. */
+SnapshotView::SnapshotView(Dax *dax, Snapshot *snapshot, QString title, QWidget *parent) : QDialog(parent) {
+    QList<QTreeWidgetItem *> items;
+    uint32_t elembits;
+
+    this->dax = dax;
+    _snapshot = snapshot;
+    setupUi(this);
+    setWindowTitle(title);
+    labelInfo->setText(QString("%1 tags, %2 bytes taken %3")
+                       .arg(snapshot->tagCount()).arg(snapshot->size())
+                       .arg(QDateTime::fromMSecsSinceEpoch(snapshot->time()).toString()));
+    if(snapshot->errors()) {
+        labelInfo->setText(labelInfo->text() + QString(" - %1 tags could not be read").arg(snapshot->errors()));
+    }
+    treeWidget->setColumnCount(3);
+    treeWidget->setHeaderLabels(QStringList({"Tagname", "Type", "Value"}));
+    treeWidget->header()->resizeSection(0, 250);
+    for(int n=0;n<snapshot->tagCount();n++) {
+        const CacheTag &t = snapshot->tag(n);
+        elembits = t.type == DAX_BOOL ? 1 : t.h.size * 8 / qMax(t.h.count, (uint32_t)1);
+        items.append(_node(snapshot->string(t.name), n, t.type, t.count, 0, elembits));
+        items.last()->setText(1, snapshot->string(t.typeName));
+    }
+    treeWidget->addTopLevelItems(items);
+    QObject::connect(treeWidget, &QTreeWidget::itemExpanded, this, &SnapshotView::expand);
+}
+
+
+/* Shows the result of a diff */
+SnapshotView::SnapshotView(const std::vector<SnapshotChange> &changes, uint64_t total, QString title, QWidget *parent) : QDialog(parent) {
+    QList<QTreeWidgetItem *> items;
+
+    dax = nullptr;
+    _snapshot = nullptr;
+    setupUi(this);
+    setWindowTitle(title);
+    if(total > changes.size()) {
+        labelInfo->setText(QString("%1 changes, showing the first %2").arg(total).arg(changes.size()));
+    } else {
+        labelInfo->setText(QString("%1 changes").arg(total));
+    }
+    treeWidget->setColumnCount(3);
+    treeWidget->setHeaderLabels(QStringList({"Tagname", "Before", "After"}));
+    treeWidget->header()->resizeSection(0, 250);
+    for(const SnapshotChange &c : changes) {
+        items.append(new QTreeWidgetItem(QStringList({c.name, c.before, c.after})));
+    }
+    treeWidget->addTopLevelItems(items);
+}
+
+
+SnapshotView::~SnapshotView() {
+    delete _snapshot;
+}
+
+
+SnapshotItem *
+SnapshotView::_node(QString name, int tag, tag_type type, uint32_t count, uint64_t bit, uint32_t elembits) {
+    SnapshotItem *item = new SnapshotItem;
+
+    item->tag = tag;
+    item->type = type;
+    item->count = count;
+    item->bit = bit;
+    item->elembits = elembits;
+    item->setText(0, name);
+    if(count > 1 || (IS_CUSTOM(type) && _snapshot->layout(type))) {
+        item->setChildIndicatorPolicy(QTreeWidgetItem::ShowIndicator);
+    } else if(!IS_CUSTOM(type)) {
+        item->setText(2, Snapshot::leafString(dax, _snapshot->data(tag), type, bit));
+    }
+    return item;
+}
+
+
+void
+SnapshotView::expand(QTreeWidgetItem *item) {
+    SnapshotItem *s = (SnapshotItem *)item;
+    QList<QTreeWidgetItem *> items;
+    const std::vector<TypeMember> *layout;
+    uint32_t n;
+
+    if(_snapshot == nullptr || item->childCount() > 0) return;
+    if(s->count > 1) {
+        for(n=0;n<s->count && n<ARRAY_ITEM_LIMIT;n++) {
+            items.append(_node(s->text(0) + "[" + QString::number(n) + "]", s->tag, s->type, 1,
+                               s->bit + (uint64_t)n * s->elembits, s->elembits));
+        }
+        if(s->count > ARRAY_ITEM_LIMIT) {
+            items.append(new QTreeWidgetItem(QStringList({QString("%1 more").arg(s->count - ARRAY_ITEM_LIMIT)})));
+        }
+    } else if((layout = _snapshot->layout(s->type))) {
+        for(const TypeMember &m : *layout) {
+            items.append(_node(s->text(0) + "." + _snapshot->string(m.name), s->tag, m.type, m.count,
+                               s->bit + m.bitoffset, m.elembits));
+        }
+    }
+    item->addChildren(items);
+}
@@ -0,0 +1,63 @@
+/*  qDAX - An open source data acquisition and control system
+ *  Copyright (c) 2023 Phil Birkelbach
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+
+ *  Header file for the dialog that shows a snapshot or a diff
+ */
+
+#ifndef _SNAPSHOT_VIEW_H
+#define _SNAPSHOT_VIEW_H
+
+#include <QTreeWidget>
+#include <vector>
+#include "ui_snapshotview.h"
+#include "dax.h"
+#include "snapshot.h"
+
+/* A node in the snapshot tree.  The children are only made when the node
+   is expanded so opening a big snapshot doesn't make millions of items. */
+class SnapshotItem : public QTreeWidgetItem
+{
+    public:
+        int tag;
+        tag_type type;
+        uint32_t count;
+        uint64_t bit;
+        uint32_t elembits;
+};
+
+
+class SnapshotView : public QDialog, public Ui_SnapshotView
+{
+    Q_OBJECT
+
+    private:
+        Dax *dax;
+        Snapshot *_snapshot;
+
+        SnapshotItem *_node(QString name, int tag, tag_type type, uint32_t count, uint64_t bit, uint32_t elembits);
+
+    public:
+        SnapshotView(Dax *dax, Snapshot *snapshot, QString title, QWidget *parent = nullptr);
+        SnapshotView(const std::vector<SnapshotChange> &changes, uint64_t total, QString title, QWidget *parent = nullptr);
+        ~SnapshotView();
+
+    public slots:
+        void expand(QTreeWidgetItem *item);
+};
+
+#endif
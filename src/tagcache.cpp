@@ -0,0 +1,236 @@
+/*  qDAX - An open source data acquisition and control system
+ *  Copyright (c) 2023 Phil Birkelbach
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+
+ *  Source code file for the on disk tag metadata cache
+ *
+ *  Enumerating a big server means a getTag() and a getHandle() for every
+ *  tag.  We save the tags, their handles and the layouts of the compound
+ *  types when we're done and load them the next time that we connect to
+ *  the same run of the same server.  Tag handles are only good for the run
+ *  of the server that gave them to us so the file is thrown out as soon as
+ *  _starttime doesn't match.
+ */
+
+#include <cstring>
+#include <QFile>
+#include <QSaveFile>
+#include <QDir>
+#include <QFileInfo>
+#include <QStandardPaths>
+#include <QCryptographicHash>
+#include "qdax.h"
+#include "tagcache.h"
+
+
+/* The file name comes from the address of the server so each server that
+   we talk to gets it's own cache */
+TagCache::TagCache(Dax *dax) {
+    QByteArray id;
+
+    this->dax = dax;
+    id = QByteArray(dax->getAttr("server").c_str()) + ":" +
+         QByteArray(dax->getAttr("port").c_str()) + ":" +
+         QByteArray(dax->getAttr("socketname").c_str());
+    _id = QCryptographicHash::hash(id, QCryptographicHash::Sha1).toHex().left(16);
+    _path = QStandardPaths::writableLocation(QStandardPaths::CacheLocation) + "/tags-" + _id + ".cache";
+}
+
+
+int
+TagCache::_readValue(const char *name, void *value, size_t size) {
+    tag_handle h;
+    uint8_t buff[8];
+    int result;
+
+    result = dax->getHandle(&h, (char *)name);
+    if(result) return result;
+    if(h.size > sizeof(buff)) return ERR_2BIG;
+    memset(buff, 0, sizeof(buff));
+    result = dax->read(h, buff);
+    if(result) return result;
+    memcpy(value, buff, size);
+    return ERR_OK;
+}
+
+
+/* Reads the system tags that we use to validate the cache.  Only
+   _lastindex has to be there.  If the server doesn't have _starttime we
+   leave it zero and the cache isn't used.  Without _tagcount we can't see
+   deletions from a server that has stayed up. */
+int
+TagCache::serverState(ServerState *st) {
+    int result;
+
+    st->lastindex = 0;
+    result = _readValue("_lastindex", &st->lastindex, sizeof(st->lastindex));
+    if(result) return result;
+    if(_readValue("_starttime", &st->starttime, sizeof(st->starttime))) st->starttime = 0;
+    if(_readValue("_tagcount", &st->tagcount, sizeof(st->tagcount))) st->tagcount = -1;
+    return ERR_OK;
+}
+
+
+/* Fills the empty model from the cache file if it belongs to the current
+   run of the server.  lastindex is set to the last tag index that the cache
+   knows about.  Anything after that has to be asked for. */
+int
+TagCache::load(TagModel *model, ServerState *st, tag_index *lastindex) {
+    const CacheHeader *hdr;
+    const CacheTag *tags;
+    const CacheType *types;
+    const TypeMember *members;
+    const char *strings;
+    std::vector<TypeMember> layout;
+    QList<TagInfo> infos;
+    TagInfo info;
+    QFile file(_path);
+    qint64 size, need;
+    uchar *map;
+
+    if(!file.open(QIODevice::ReadOnly)) return ERR_NOTFOUND;
+    size = file.size();
+    if(size < (qint64)sizeof(CacheHeader)) return ERR_NOTFOUND;
+    map = file.map(0, size);
+    if(map == nullptr) return ERR_NOTFOUND;
+
+    hdr = (const CacheHeader *)map;
+    need = sizeof(CacheHeader) + (qint64)hdr->tags * sizeof(CacheTag) + (qint64)hdr->types * sizeof(CacheType) +
+           (qint64)hdr->members * sizeof(TypeMember) + hdr->strings;
+    if(memcmp(hdr->magic, TAGCACHE_MAGIC, 4) || hdr->version != TAGCACHE_VERSION ||
+       hdr->handleSize != sizeof(tag_handle) || need != size || hdr->strings == 0) {
+        file.unmap(map);
+        return ERR_ARG;
+    }
+    if(st->starttime == 0 || hdr->starttime != st->starttime || hdr->lastindex > st->lastindex) {
+        file.unmap(map);
+        return ERR_NOTFOUND;
+    }
+    tags = (const CacheTag *)(map + sizeof(CacheHeader));
+    types = (const CacheType *)(tags + hdr->tags);
+    members = (const TypeMember *)(types + hdr->types);
+    strings = (const char *)(members + hdr->members);
+    if(strings[hdr->strings - 1] != '\0') {
+        file.unmap(map);
+        return ERR_ARG;
+    }
+
+    /* The layouts go in first so that building the tags doesn't need to
+       ask the server about the types */
+    for(uint32_t n=0;n<hdr->types;n++) {
+        if(types[n].first > hdr->members || types[n].count > hdr->members - types[n].first) continue;
+        layout.clear();
+        for(uint32_t i=0;i<types[n].count;i++) {
+            TypeMember m = members[types[n].first + i];
+            if(m.name >= hdr->strings) continue;
+            m.name = model->_intern(QString(&strings[m.name]));
+            layout.push_back(m);
+        }
+        model->_layouts[types[n].type] = layout;
+    }
+    infos.reserve(hdr->tags);
+    for(uint32_t n=0;n<hdr->tags;n++) {
+        if(tags[n].name >= hdr->strings || tags[n].typeName >= hdr->strings) continue;
+        memset(&info.tag, 0, sizeof(info.tag));
+        info.tag.idx = tags[n].idx;
+        info.tag.type = tags[n].type;
+        info.tag.count = tags[n].count;
+        info.tag.attr = tags[n].attr;
+        strncpy(info.tag.name, &strings[tags[n].name], sizeof(info.tag.name) - 1);
+        info.h = tags[n].h;
+        model->_typeNames.insert(((quint64)info.tag.type << 32) | info.tag.count, QString(&strings[tags[n].typeName]));
+        infos.append(info);
+    }
+    /* One insert for the whole lot so the view and the sort proxy only
+       have to deal with it once */
+    model->addTags(infos);
+    *lastindex = hdr->lastindex;
+    file.unmap(map);
+    return ERR_OK;
+}
+
+
+static uint32_t
+_add_string(QByteArray *strings, QString str) {
+    uint32_t offset = strings->size();
+
+    strings->append(str.toUtf8());
+    strings->append('\0');
+    return offset;
+}
+
+
+/* Writes everything that the model knows about the server to the cache */
+int
+TagCache::save(TagModel *model, ServerState *st) {
+    std::vector<CacheTag> tags;
+    std::vector<CacheType> types;
+    std::vector<TypeMember> members;
+    QByteArray strings;
+    CacheHeader hdr;
+    CacheTag ct;
+    CacheType t;
+    RootTag *r;
+
+    if(st->starttime == 0) return ERR_NOTFOUND;
+    for(int n=0;n<model->rootCount();n++) {
+        r = model->root(n);
+        memset(&ct, 0, sizeof(ct));
+        ct.h = r->h;
+        ct.idx = r->idx;
+        ct.type = model->_type[r->node];
+        ct.count = model->_count[r->node];
+        ct.attr = r->readonly ? TAG_ATTR_READONLY : 0;
+        ct.name = _add_string(&strings, model->_names[model->_name[r->node]]);
+        ct.typeName = _add_string(&strings, r->typeName);
+        tags.push_back(ct);
+    }
+    for(auto &it : model->_layouts) {
+        t.type = it.first;
+        t.first = members.size();
+        t.count = it.second.size();
+        for(TypeMember m : it.second) {
+            m.name = _add_string(&strings, model->_names[m.name]);
+            members.push_back(m);
+        }
+        types.push_back(t);
+    }
+    if(strings.isEmpty()) strings.append('\0');
+
+    memset(&hdr, 0, sizeof(hdr));
+    memcpy(hdr.magic, TAGCACHE_MAGIC, 4);
+    hdr.version = TAGCACHE_VERSION;
+    hdr.handleSize = sizeof(tag_handle);
+    hdr.lastindex = st->lastindex;
+    hdr.starttime = st->starttime;
+    hdr.tagcount = st->tagcount;
+    hdr.tags = tags.size();
+    hdr.types = types.size();
+    hdr.members = members.size();
+    hdr.strings = strings.size();
+
+    QDir().mkpath(QFileInfo(_path).path());
+    QSaveFile file(_path);
+    if(!file.open(QIODevice::WriteOnly)) return ERR_NOTFOUND;
+    file.write((const char *)&hdr, sizeof(hdr));
+    file.write((const char *)tags.data(), tags.size() * sizeof(CacheTag));
+    file.write((const char *)types.data(), types.size() * sizeof(CacheType));
+    file.write((const char *)members.data(), members.size() * sizeof(TypeMember));
+    file.write(strings);
+    if(!file.commit()) return ERR_NOTFOUND;
+    return ERR_OK;
+}
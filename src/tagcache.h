@@ -0,0 +1,91 @@
+/*  qDAX - An open source data acquisition and control system
+ *  Copyright (c) 2023 Phil Birkelbach
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+
+ *  Header file for the on disk tag metadata cache
+ */
+
+#ifndef TAGCACHE_H
+#define TAGCACHE_H
+
+#include <QString>
+#include "dax.h"
+#include "tagmodel.h"
+
+#define TAGCACHE_MAGIC "QDXC"
+#define TAGCACHE_VERSION 1
+
+/* The things that we can read cheaply from the server to tell whether
+   what we know about it's tags is still good.  _starttime tells us that
+   it's the same run of the server, _lastindex grows as tags are added and
+   _tagcount goes down when they are deleted. */
+struct ServerState {
+    int64_t starttime;
+    tag_index lastindex;
+    int32_t tagcount;   /* -1 if the server doesn't have _tagcount */
+};
+
+/* The file is a header followed by the tag records, the type records, the
+   member records and then a table of nul terminated strings.  Everything is
+   fixed size so it can be used straight out of a memory map. */
+struct CacheHeader {
+    char magic[4];
+    uint32_t version;
+    uint32_t handleSize;
+    int32_t lastindex;
+    int64_t starttime;
+    int32_t tagcount;
+    uint32_t tags;
+    uint32_t types;
+    uint32_t members;
+    uint32_t strings;
+};
+
+struct CacheTag {
+    tag_handle h;
+    tag_index idx;
+    tag_type type;
+    uint32_t count;
+    uint32_t attr;
+    uint32_t name;      /* Offsets into the string table */
+    uint32_t typeName;
+};
+
+struct CacheType {
+    tag_type type;
+    uint32_t first;     /* First member record */
+    uint32_t count;
+};
+
+class TagCache
+{
+    private:
+        Dax *dax;
+        QString _id;
+        QString _path;
+
+        int _readValue(const char *name, void *value, size_t size);
+
+    public:
+        TagCache(Dax *dax);
+        QString id(void) { return _id; };
+        int serverState(ServerState *st);
+        int load(TagModel *model, ServerState *st, tag_index *lastindex);
+        int save(TagModel *model, ServerState *st);
+};
+
+#endif
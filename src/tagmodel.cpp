@@ -0,0 +1,1291 @@
+/*  qDAX - An open source data acquisition and control system
+ *  Copyright (c) 2023 Phil Birkelbach
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+
+ *  Source code file for the model that backs the tag tree
+ *
+ *  A node costs us seven 32 bit words in the tables below.  Nothing is kept
+ *  for a node that can be worked out when it's displayed.  The offset of
+ *  each member is found from the layout of it's type, which we only ask the
+ *  server about once per type instead of getting a handle for every member
+ *  of every tag.
+ */
+
+#include <cstring>
+#include <algorithm>
+#include <QBrush>
+#include <QDateTime>
+#include <QThread>
+#include <QSemaphore>
+#include "qdax.h"
+#include "tagmodel.h"
+#include "arraystats.h"
+#include "bitdiff.h"
+#include "trace.h"
+
+/* BOOL values are drawn a lot so the strings are only made once */
+static const QString _true = QStringLiteral("true");
+static const QString _false = QStringLiteral("false");
+
+
+/* Counts the bytes that differ between a and b.  This is written so that
+   the compiler can vectorize it. */
+static uint32_t
+_diff_bytes(const uint8_t *a, const uint8_t *b, uint32_t size) {
+    uint32_t count = 0;
+
+    for(uint32_t n=0;n<size;n++) {
+        count += (a[n] != b[n]);
+    }
+    return count;
+}
+
+
+/* Mask of the bits from 'from' up to but not including 'to' in one byte */
+static inline uint8_t
+_bit_mask(uint32_t from, uint32_t to) {
+    return (uint8_t)((0xFF << from) & (0xFF >> (8 - to)));
+}
+
+
+/* True if any of the bits in [start, end) are different.  The whole bytes
+   in the middle go to memcmp() which is vectorized. */
+static bool
+_bits_differ(const uint8_t *a, const uint8_t *b, uint32_t start, uint32_t end) {
+    uint32_t first = start / 8, last = end / 8;
+
+    if(first == last) return ((a[first] ^ b[first]) & _bit_mask(start % 8, end % 8)) != 0;
+    if(start % 8) {
+        if((a[first] ^ b[first]) & _bit_mask(start % 8, 8)) return true;
+        first++;
+    }
+    if(end % 8 && ((a[last] ^ b[last]) & _bit_mask(0, end % 8))) return true;
+    return memcmp(&a[first], &b[first], last - first) != 0;
+}
+
+
+/* Counts the bits in [start, end) that are different */
+static uint32_t
+_diff_bits(const uint8_t *a, const uint8_t *b, uint32_t start, uint32_t end) {
+    uint32_t first = start / 8, last = end / 8;
+    uint32_t count = 0;
+    uint64_t x, y;
+
+    if(first == last) return __builtin_popcount((a[first] ^ b[first]) & _bit_mask(start % 8, end % 8));
+    if(start % 8) {
+        count += __builtin_popcount((a[first] ^ b[first]) & _bit_mask(start % 8, 8));
+        first++;
+    }
+    if(end % 8) count += __builtin_popcount((a[last] ^ b[last]) & _bit_mask(0, end % 8));
+    for(;first + 8 <= last;first += 8) {
+        memcpy(&x, &a[first], 8);
+        memcpy(&y, &b[first], 8);
+        count += __builtin_popcountll(x ^ y);
+    }
+    for(;first<last;first++) count += __builtin_popcount(a[first] ^ b[first]);
+    return count;
+}
+
+
+/* Counts the elements of size bytes that are different.  Blocks that are
+   the same are skipped with memcmp() and only the blocks that are
+   different are looked at element by element. */
+static uint32_t
+_diff_elements(const uint8_t *a, const uint8_t *b, uint32_t count, uint32_t size) {
+    uint32_t per = size >= FREEZE_BLOCK_SIZE ? 1 : FREEZE_BLOCK_SIZE / size;
+    uint32_t changed = 0, n, end;
+
+    for(n=0;n<count;n+=per) {
+        end = std::min(count, n + per);
+        if(memcmp(&a[n * size], &b[n * size], (end - n) * size) == 0) continue;
+        for(uint32_t i=n;i<end;i++) {
+            changed += memcmp(&a[i * size], &b[i * size], size) != 0;
+        }
+    }
+    return changed;
+}
+
+
+/* The scanners for each kind of plan step.  They compare the new data
+   with the old for n steps of the same kind and write the nodes of the
+   ones that changed to out.  There are no branches on the result so the
+   loops stay tight no matter how many of the leaves changed. */
+typedef uint32_t (*PlanScanner)(const uint8_t *, const uint8_t *, const PlanStep *, uint32_t, uint32_t *);
+
+template<typename T>
+static uint32_t
+_scan(const uint8_t *a, const uint8_t *b, const PlanStep *s, uint32_t n, uint32_t *out) {
+    uint32_t count = 0;
+    T x, y;
+
+    for(uint32_t i=0;i<n;i++) {
+        memcpy(&x, &a[s[i].bit / 8], sizeof(T));
+        memcpy(&y, &b[s[i].bit / 8], sizeof(T));
+        out[count] = s[i].node;
+        count += (x != y);
+    }
+    return count;
+}
+
+
+static uint32_t
+_scan_bit(const uint8_t *a, const uint8_t *b, const PlanStep *s, uint32_t n, uint32_t *out) {
+    uint32_t count = 0;
+
+    for(uint32_t i=0;i<n;i++) {
+        out[count] = s[i].node;
+        count += ((a[s[i].bit / 8] ^ b[s[i].bit / 8]) >> (s[i].bit % 8)) & 0x01;
+    }
+    return count;
+}
+
+
+static uint32_t
+_scan_bits(const uint8_t *a, const uint8_t *b, const PlanStep *s, uint32_t n, uint32_t *out) {
+    uint32_t count = 0;
+
+    for(uint32_t i=0;i<n;i++) {
+        out[count] = s[i].node;
+        count += _bits_differ(a, b, s[i].bit, s[i].bit + s[i].size);
+    }
+    return count;
+}
+
+
+static uint32_t
+_scan_block(const uint8_t *a, const uint8_t *b, const PlanStep *s, uint32_t n, uint32_t *out) {
+    uint32_t count = 0;
+
+    for(uint32_t i=0;i<n;i++) {
+        out[count] = s[i].node;
+        count += memcmp(&a[s[i].bit / 8], &b[s[i].bit / 8], s[i].size) != 0;
+    }
+    return count;
+}
+
+
+/* The elements of a BOOL array that has nodes.  The node of the step is
+   the first element and the elements follow it in the table. */
+static uint32_t
+_scan_bools(const uint8_t *a, const uint8_t *b, const PlanStep *s, uint32_t n, uint32_t *out) {
+    uint32_t count = 0;
+
+    for(uint32_t i=0;i<n;i++) {
+        count += bit_diff(a, b, s[i].bit, s[i].size, s[i].node, &out[count]);
+    }
+    return count;
+}
+
+
+/* Indexed by the PLAN_ kinds */
+static const PlanScanner _scanners[] = {
+    _scan_bit, _scan_bits, _scan<uint8_t>, _scan<uint16_t>,
+    _scan<uint32_t>, _scan<uint64_t>, _scan_block, _scan_bools
+};
+
+
+/* Plan kind for a single value of a base type.  Integers of the same size
+   are all the same to us and so are the floats since we compare the bits. */
+static uint8_t
+_plan_kind(tag_type type) {
+    switch(type) {
+        case DAX_BOOL:  return PLAN_BIT;
+        case DAX_BYTE:
+        case DAX_SINT:
+        case DAX_CHAR:  return PLAN_8;
+        case DAX_WORD:
+        case DAX_UINT:
+        case DAX_INT:   return PLAN_16;
+        case DAX_DWORD:
+        case DAX_UDINT:
+        case DAX_DINT:
+        case DAX_REAL:  return PLAN_32;
+        case DAX_LWORD:
+        case DAX_ULINT:
+        case DAX_LINT:
+        case DAX_TIME:
+        case DAX_LREAL: return PLAN_64;
+    }
+    return PLAN_BLOCK;
+}
+
+
+TagModel::TagModel(Dax *dax, TagArena *arena, QObject *parent) : QAbstractItemModel(parent) {
+    this->dax = dax;
+    _arena = arena;
+    _holes = 0;
+    _frozen = false;
+    _staleTime = 1000;
+    /* The thread that calls updateTags() does one of the parts itself */
+    _pool.setMaxThreadCount(std::max(1, std::min(UPDATE_MAX_THREADS, QThread::idealThreadCount()) - 1));
+}
+
+
+TagModel::~TagModel() {
+    clear();
+}
+
+
+uint32_t
+TagModel::_intern(QString name) {
+    uint32_t id;
+
+    id = _nameIds.value(name, NAME_ELEMENT);
+    if(id == NAME_ELEMENT) {
+        id = _names.size();
+        _names.push_back(name);
+        _nameIds.insert(name, id);
+    }
+    return id;
+}
+
+
+/* Adds count empty nodes to the end of the table and returns the first */
+uint32_t
+TagModel::_newNodes(uint32_t count) {
+    uint32_t first = _parent.size();
+    size_t size = first + count;
+
+    _parent.resize(size, NODE_NONE);
+    _first.resize(size, NODE_NONE);
+    _children.resize(size, 0);
+    _bitoffset.resize(size, 0);
+    _count.resize(size, 1);
+    _type.resize(size, 0);
+    _name.resize(size, NAME_ELEMENT);
+    return first;
+}
+
+
+/* Returns the member layout of a compound type.  The first time that we
+   see a type we get handles for the members of the given instance, which
+   starts at bitoffset, and keep the offsets relative to the start of the
+   structure. */
+const std::vector<TypeMember> *
+TagModel::_layout(tag_type type, QString instance, uint32_t bitoffset) {
+    std::vector<TypeMember> layout;
+    TypeMember tm;
+    tag_handle h;
+    QString name;
+
+    auto it = _layouts.find(type);
+    if(it != _layouts.end()) return &it->second;
+
+    for(cdt_iter m : dax->getTypeMembers(type)) {
+        name = instance + "." + m.name;
+        if(dax->getHandle(&h, (char *)name.toStdString().c_str())) {
+            dax_log(DAX_LOG_ERROR, "Unable to get tag handle ");
+            continue;
+        }
+        tm.name = _intern(m.name);
+        tm.type = m.type;
+        tm.count = m.count;
+        tm.bitoffset = h.byte * 8 + h.bit - bitoffset;
+        tm.elembits = m.type == DAX_BOOL ? 1 : h.size * 8 / h.count;
+        layout.push_back(tm);
+    }
+    /* unordered_map doesn't move it's values so this pointer stays good
+       while we recurse and add other types */
+    return &_layouts.emplace(type, layout).first->second;
+}
+
+
+/* Adds the children of node to the table.  name is the full name of the
+   node, which we only need to find the layout of types we haven't seen yet,
+   and elembits is the size of one element if the node is an array. */
+void
+TagModel::_build(uint32_t node, QString name, uint32_t elembits) {
+    const std::vector<TypeMember> *layout;
+    tag_type type = _type[node];
+    uint32_t count = _count[node];
+    uint32_t bits = _bitoffset[node];
+    uint32_t first, n;
+
+    if(count > 1) {
+        if(count > ARRAY_ITEM_LIMIT) return;
+        first = _newNodes(count);
+        _first[node] = first;
+        _children[node] = count;
+        for(n=0;n<count;n++) {
+            _parent[first + n] = node;
+            _type[first + n] = type;
+            _bitoffset[first + n] = bits + n * elembits;
+        }
+        if(dax->isCustom(type)) {
+            for(n=0;n<count;n++) {
+                _build(first + n, name + "[" + QString::number(n) + "]", 0);
+            }
+        }
+    } else if(dax->isCustom(type)) {
+        layout = _layout(type, name, bits);
+        first = _newNodes(layout->size());
+        _first[node] = first;
+        _children[node] = layout->size();
+        for(n=0;n<layout->size();n++) {
+            const TypeMember &m = (*layout)[n];
+            _parent[first + n] = node;
+            _type[first + n] = m.type;
+            _count[first + n] = m.count;
+            _name[first + n] = m.name;
+            _bitoffset[first + n] = bits + m.bitoffset;
+        }
+        for(n=0;n<layout->size();n++) {
+            const TypeMember &m = (*layout)[n];
+            if(m.count > 1 || dax->isCustom(m.type)) {
+                _build(first + n, name + "." + _names[m.name], m.elembits);
+            }
+        }
+    }
+}
+
+
+/* Deleted tags leave holes in the node table.  When there are too many we
+   copy the live nodes down and tell the view to start over. */
+void
+TagModel::_compact(void) {
+    std::vector<uint32_t> parent, first, children, bitoffset, count, name;
+    std::vector<tag_type> type;
+    size_t size = nodes();
+    uint32_t base;
+
+    beginResetModel();
+    parent.reserve(size); first.reserve(size); children.reserve(size);
+    bitoffset.reserve(size); count.reserve(size); name.reserve(size);
+    type.reserve(size);
+    _rootNodes.clear();
+    for(RootTag *r : _rows) {
+        base = parent.size();
+        for(uint32_t n=r->node;n<r->nodeEnd;n++) {
+            parent.push_back(_parent[n] == NODE_NONE ? NODE_NONE : _parent[n] - r->node + base);
+            first.push_back(_children[n] ? _first[n] - r->node + base : NODE_NONE);
+            children.push_back(_children[n]);
+            bitoffset.push_back(_bitoffset[n]);
+            count.push_back(_count[n]);
+            type.push_back(_type[n]);
+            name.push_back(_name[n]);
+        }
+        r->node = base;
+        r->nodeEnd = parent.size();
+        _rootNodes[base] = r;
+    }
+    _parent.swap(parent); _first.swap(first); _children.swap(children);
+    _bitoffset.swap(bitoffset); _count.swap(count); _type.swap(type);
+    _name.swap(name);
+    _holes = 0;
+    endResetModel();
+}
+
+
+/* Builds the decode plan for a tag.  All of the checks for arrays,
+   structures and bits are done here once so that _countChanges() only has
+   to run the scanners.  Big arrays that don't have element nodes are one
+   step for the whole array and so are the elements of a BOOL array. */
+void
+TagModel::_compile(RootTag *r) {
+    struct { PlanStep step; uint8_t kind; } leaf;
+    std::vector<decltype(leaf)> leaves;
+    uint32_t start, end, p;
+
+    r->planLeaves = 0;
+    for(uint32_t n=r->node;n<r->nodeEnd;n++) {
+        if(_children[n] && _type[n] == DAX_BOOL && _count[n] > 1) {
+            leaf.kind = PLAN_BOOLS;
+            leaf.step.bit = _bitoffset[n];
+            leaf.step.size = _children[n];
+            leaf.step.node = _first[n] - r->node;
+            leaves.push_back(leaf);
+            r->planLeaves += _children[n];
+            continue;
+        }
+        if(_children[n]) continue;
+        p = _parent[n];
+        if(p != NODE_NONE && _type[p] == DAX_BOOL && _count[p] > 1) continue;
+        start = _bitoffset[n];
+        end = _nodeEnd(n);
+        if(end <= start) continue;
+        leaf.step.bit = start;
+        leaf.step.node = n - r->node;
+        if(_count[n] > 1 && _type[n] == DAX_BOOL) {
+            leaf.kind = PLAN_BITS;
+            leaf.step.size = _count[n];
+        } else if(_count[n] > 1) {
+            leaf.kind = PLAN_BLOCK;
+            leaf.step.size = (end - start + 7) / 8;
+        } else {
+            leaf.kind = _plan_kind(_type[n]);
+            leaf.step.size = (end - start + 7) / 8;
+        }
+        leaves.push_back(leaf);
+        r->planLeaves++;
+    }
+    std::stable_sort(leaves.begin(), leaves.end(), [](const decltype(leaf) &a, const decltype(leaf) &b) {
+        return a.step.bit < b.step.bit;
+    });
+    r->plan.clear();
+    r->runs.clear();
+    r->plan.reserve(leaves.size());
+    for(const auto &l : leaves) {
+        if(r->runs.empty() || r->runs.back().kind != l.kind) {
+            r->runs.push_back({l.kind, (uint32_t)r->plan.size(), 0});
+        }
+        r->runs.back().count++;
+        r->plan.push_back(l.step);
+    }
+}
+
+
+/* Makes the RootTag and the nodes for a tag at the end of the rows.  The
+   caller does the begin/endInsertRows() around it. */
+RootTag *
+TagModel::_newRoot(dax_tag tag, const tag_handle &h) {
+    RootTag *r;
+
+    r = new RootTag;
+    r->h = h;
+    r->idx = tag.idx;
+    r->readonly = (tag.attr & TAG_ATTR_READONLY) ? true : false;
+    r->primed = false;
+    r->dirty = false;
+    r->full = false;
+    r->pollInterval = 0;
+    r->nextPoll = 0;
+    r->lastRead = 0;
+    r->considered = 0;
+    r->version = 0;
+    r->stale = false;
+    r->typeName = _typeString(tag.type, tag.count);
+    r->paged = tag.count > ARRAY_ITEM_LIMIT && r->h.size > ARRAY_POLL_LIMIT;
+    r->frozenChanges = 0;
+    if(r->paged) {
+        r->data = r->prev = r->frozen = nullptr;
+        r->stats = "Open in the array view";
+    } else {
+        /* Plane 0 of the arena holds the current data and plane 1 the data
+           from the last read that _countChanges() compares against */
+        r->data = _arena->alloc(r->h.size);
+        r->prev = _arena->plane(r->data, 1);
+        /* Plane 2, if the arena has one, is the copy for freeze() */
+        r->frozen = _arena->planes() > 2 ? _arena->plane(r->data, 2) : nullptr;
+        memset(r->data, 0, r->h.size);
+    }
+    r->row = _rows.size();
+
+    r->node = _newNodes(1);
+    _name[r->node] = _intern(tag.name);
+    _type[r->node] = tag.type;
+    _count[r->node] = tag.count;
+    _build(r->node, tag.name, tag.type == DAX_BOOL ? 1 : r->h.size * 8 / tag.count);
+    r->nodeEnd = _parent.size();
+    r->members.resize(_children[r->node]);
+    _rows.push_back(r);
+    _tags.insert(r->idx, r);
+    _rootNodes[r->node] = r;
+    _compile(r);
+    return r;
+}
+
+
+/* Adds a top level tag and all of it's members to the model.  If we
+   already have a handle for the tag, from the cache, it can be passed in
+   and we don't ask the server for it. */
+int
+TagModel::addTag(dax_tag tag, const tag_handle *h) {
+    tag_handle handle;
+    int result;
+
+    if(h) {
+        handle = *h;
+    } else {
+        result = dax->getHandle(&handle, tag.name);
+        if(result) {
+            dax_log(DAX_LOG_ERROR, "Unable to get tag handle ");
+            return result;
+        }
+    }
+    beginInsertRows(QModelIndex(), _rows.size(), _rows.size());
+    _newRoot(tag, handle);
+    endInsertRows();
+    return ERR_OK;
+}
+
+
+/* Adds a batch of tags that we already have the handles for.  The view
+   gets one insert for all of them. */
+void
+TagModel::addTags(const QList<TagInfo> &tags) {
+    if(tags.isEmpty()) return;
+    beginInsertRows(QModelIndex(), _rows.size(), _rows.size() + tags.size() - 1);
+    for(const TagInfo &t : tags) {
+        _newRoot(t.tag, t.h);
+    }
+    endInsertRows();
+}
+
+
+void
+TagModel::removeTag(tag_index idx) {
+    removeTags(QList<tag_index>({idx}));
+}
+
+
+/* Removes a batch of tags.  Rows that are next to each other go out to
+   the view as one removal and the rows after them are only renumbered
+   once for each run. */
+void
+TagModel::removeTags(const QList<tag_index> &tags) {
+    std::vector<int> rows;
+    RootTag *r;
+    size_t i, j;
+
+    for(tag_index idx : tags) {
+        r = _tags.take(idx);
+        if(r) rows.push_back(r->row);
+    }
+    if(rows.empty()) return;
+    std::sort(rows.begin(), rows.end(), std::greater<int>());
+    /* Each run is [rows[j - 1], rows[i]] counting down from the bottom */
+    for(i=0;i<rows.size();i=j) {
+        for(j=i+1;j<rows.size() && rows[j] == rows[j - 1] - 1;j++);
+        beginRemoveRows(QModelIndex(), rows[j - 1], rows[i]);
+        for(int row=rows[j - 1];row<=rows[i];row++) {
+            r = _rows[row];
+            _rootNodes.erase(r->node);
+            _holes += r->nodeEnd - r->node;
+            _arena->free(r->data, r->h.size);
+            delete r;
+        }
+        _rows.erase(_rows.begin() + rows[j - 1], _rows.begin() + rows[i] + 1);
+        for(size_t n=rows[j - 1];n<_rows.size();n++) {
+            _rows[n]->row = n;
+        }
+        endRemoveRows();
+    }
+    if(_holes > _parent.size() / 2) _compact();
+}
+
+
+void
+TagModel::clear(void) {
+    beginResetModel();
+    for(RootTag *r : _rows) {
+        _arena->free(r->data, r->h.size);
+        delete r;
+    }
+    _rows.clear();
+    _tags.clear();
+    _rootNodes.clear();
+    _parent.clear(); _first.clear(); _children.clear();
+    _bitoffset.clear(); _count.clear(); _type.clear(); _name.clear();
+    _holes = 0;
+    _names.clear();
+    _nameIds.clear();
+    forgetTypes();
+    endResetModel();
+}
+
+
+/* Type numbers belong to the server so the layouts that we have cached
+   can't be trusted after we reconnect */
+void
+TagModel::forgetTypes(void) {
+    _layouts.clear();
+    _typeNames.clear();
+}
+
+
+/* Returns true if the given tag looks like the one that r was built from.
+   Type numbers can change when the server restarts so we compare the type
+   by name. */
+bool
+TagModel::matches(RootTag *r, dax_tag tag) {
+    std::string *typestr;
+    bool result;
+
+    if(_names[_name[r->node]] != QString(tag.name)) return false;
+    typestr = dax->typeString(tag.type, tag.count);
+    result = r->typeName == QString(typestr->c_str());
+    delete typestr;
+    return result;
+}
+
+
+/* Gets a fresh handle for the tag after a reconnect.  If the size or the
+   type number has changed then the layout that we built the nodes from is
+   no good and we return false so that the caller can rebuild the tag. */
+bool
+TagModel::rebind(RootTag *r, dax_tag tag) {
+    tag_handle newh;
+    int result;
+
+    result = dax->getHandle(&newh, tag.name);
+    if(result || newh.size != r->h.size || newh.type != r->h.type) return false;
+    _tags.remove(r->idx);
+    r->h = newh;
+    r->idx = tag.idx;
+    _tags.insert(r->idx, r);
+    return true;
+}
+
+
+/* Puts the statistics of a numeric array in the stats column of the root.
+   Types that array_stats() doesn't handle are just left blank. */
+void
+TagModel::_updateStats(RootTag *r) {
+    ArrayStats st;
+
+    if(dax->isCustom(r->h.type)) return;
+    if(array_stats(r->h.type, r->data, r->h.count, &st) != ERR_OK) return;
+    r->stats = QString("min %1  max %2  mean %3  sd %4")
+                      .arg(st.min, 0, 'g', 6).arg(st.max, 0, 'g', 6)
+                      .arg(st.mean, 0, 'g', 6).arg(st.stddev, 0, 'g', 6);
+    if(r->h.type == DAX_REAL || r->h.type == DAX_LREAL) {
+        r->stats += QString("  NaN %1").arg(st.nans);
+    }
+}
+
+
+/* Compares the data that was just read with what we had the last time and
+   updates the activity counters for the tag and for each of it's direct
+   children.  Most tags don't change between reads so the memcmp() is
+   usually all that we do.  Returns true if anything needs to be redrawn. */
+bool
+TagModel::_countChanges(RootTag *r, qint64 now) {
+    const uint8_t *data = (const uint8_t *)r->data;
+    const uint8_t *prev = (const uint8_t *)r->prev;
+    uint32_t child, first, nchild, start, end, count;
+    uint8_t mask;
+
+    if(!r->primed) {
+        memcpy(r->prev, r->data, r->h.size);
+        /* A tag that shows up after the freeze starts out unchanged */
+        if(_frozen) memcpy(r->frozen, r->data, r->h.size);
+        r->primed = true;
+        r->full = true;
+        return true;
+    }
+    if(memcmp(data, prev, r->h.size) == 0) return false;
+
+    /* Added to the end in case the view hasn't been told about the last
+       changes yet */
+    count = r->changed.size();
+    r->changed.resize(count + r->planLeaves);
+    for(const PlanRun &run : r->runs) {
+        count += _scanners[run.kind](data, prev, &r->plan[run.first], run.count, &r->changed[count]);
+    }
+    r->changed.resize(count);
+
+    r->activity.changes++;
+    r->activity.bytes += _diff_bytes(data, prev, r->h.size);
+    r->activity.last = now;
+    first = _first[r->node];
+    nchild = _children[r->node];
+    for(uint32_t n=0;n<nchild;n++) {
+        child = first + n;
+        start = _bitoffset[child];
+        if(_type[child] == DAX_BOOL && _count[child] == 1) {
+            mask = 0x01 << (start % 8);
+            count = ((data[start / 8] ^ prev[start / 8]) & mask) ? 1 : 0;
+        } else {
+            /* A child runs up to where the next one starts */
+            end = (n + 1 < nchild) ? _bitoffset[child + 1] : r->h.size * 8;
+            count = end > start ? _diff_bytes(&data[start / 8], &prev[start / 8], (end - start + 7) / 8) : 0;
+        }
+        if(count) {
+            r->members[n].changes++;
+            r->members[n].bytes += count;
+            r->members[n].last = now;
+        }
+    }
+    memcpy(r->prev, r->data, r->h.size);
+    return true;
+}
+
+
+/* Called after the data for r has been read.  The tag is marked so that
+   the next flushChanges() tells the view about it. */
+void
+TagModel::updateTag(RootTag *r, qint64 now) {
+    if(r->paged || !_countChanges(r, now)) return;
+    if(r->h.count > 1) _updateStats(r);
+    if(_frozen) r->frozenChanges = _frozenChanges(r);
+    r->dirty = true;
+}
+
+
+/* Same as calling updateTag() for every row after they have all been read */
+void
+TagModel::updateTags(qint64 now) {
+    updateTags(_rows, now);
+}
+
+
+/* Same as calling updateTag() for each of the tags after they have all
+   been read.  Each tag only touches it's own RootTag so big refreshes are
+   split up by size between the pool and this thread.  The view is only
+   told about the changes afterwards, in flushChanges(), back on this
+   thread. */
+void
+TagModel::updateTags(const std::vector<RootTag *> &tags, qint64 now) {
+    std::vector<size_t> bounds;
+    QSemaphore done;
+    size_t total = 0, bytes = 0, lo, hi;
+    int threads, jobs = 0;
+    TraceScope span("TagModel::updateTags");
+
+    for(RootTag *r : tags) if(!r->paged) total += r->h.size;
+    span.bytes = total;
+    threads = _pool.maxThreadCount() + 1;
+    if(total < UPDATE_PARALLEL_BYTES || threads < 2) {
+        for(RootTag *r : tags) updateTag(r, now);
+        return;
+    }
+    bounds.push_back(0);
+    for(size_t n=0;n<tags.size();n++) {
+        if(!tags[n]->paged) bytes += tags[n]->h.size;
+        while((int)bounds.size() < threads && bytes >= total * bounds.size() / threads) {
+            bounds.push_back(n + 1);
+        }
+    }
+    bounds.push_back(tags.size());
+    for(size_t k=1;k+1<bounds.size();k++) {
+        lo = bounds[k];
+        hi = bounds[k + 1];
+        if(lo >= hi) continue;
+        jobs++;
+        _pool.start([this, &tags, lo, hi, now, &done]() {
+            TraceScope span("TagModel::updateTags part");
+            for(size_t n=lo;n<hi;n++) updateTag(tags[n], now);
+            done.release();
+        });
+    }
+    for(size_t n=bounds[0];n<bounds[1];n++) updateTag(tags[n], now);
+    done.acquire(jobs);
+}
+
+
+/* A tag is stale when the scheduler hasn't gotten to it for more than the
+   stale time after it was due.  The rows are redrawn when that changes so
+   that they go grey and come back. */
+void
+TagModel::markStale(qint64 now) {
+    bool stale;
+
+    for(RootTag *r : _rows) {
+        stale = r->nextPoll && now - r->nextPoll > _staleTime;
+        if(stale == r->stale) continue;
+        r->stale = stale;
+        r->dirty = true;
+        r->full = true;
+    }
+}
+
+
+/* Tells the view about the tags that have changed since the last call.
+   Runs of neighbouring rows go out as one signal, which also keeps the
+   sort proxy from having to look at the rows that didn't change. */
+void
+TagModel::flushChanges(void) {
+    int first = -1;
+    int size = _rows.size();
+    TraceScope span("TagModel::flushChanges");
+
+    for(int row=0;row<=size;row++) {
+        if(row < size && _rows[row]->dirty) {
+            if(first < 0) first = row;
+            continue;
+        }
+        if(first < 0) continue;
+        emit dataChanged(createIndex(first, VALUE_COLUMN, _rows[first]->node),
+                         createIndex(row - 1, CHANGES_COLUMN, _rows[row - 1]->node));
+        first = -1;
+    }
+    for(RootTag *r : _rows) {
+        if(!r->dirty) continue;
+        r->dirty = false;
+        if(!r->full) {
+            _emitChanged(r);
+            continue;
+        }
+        r->full = false;
+        r->changed.clear();
+        for(uint32_t n=r->node;n<r->nodeEnd;n++) {
+            if(_children[n] == 0) continue;
+            emit dataChanged(createIndex(0, _frozen ? NAME_COLUMN : VALUE_COLUMN, _first[n]),
+                             createIndex(_children[n] - 1, _frozen ? CHANGES_COLUMN : VALUE_COLUMN,
+                                         _first[n] + _children[n] - 1));
+        }
+    }
+}
+
+
+/* Tells the view about the leaves that the plan found had changed.
+   Neighbours with the same parent go out as one signal.  While we are
+   frozen the parents of the leaves are sent too since their highlight
+   can change. */
+void
+TagModel::_emitChanged(RootTag *r) {
+    std::vector<uint32_t> &c = r->changed;
+    uint32_t node, p, row;
+    size_t i, j, n = c.size();
+
+    if(_frozen) {
+        for(i=0;i<n;i++) {
+            if(c[i] == 0) continue;
+            for(p=_parent[r->node + c[i]];p!=r->node;p=_parent[p]) c.push_back(p - r->node);
+        }
+    }
+    std::sort(c.begin(), c.end());
+    c.erase(std::unique(c.begin(), c.end()), c.end());
+    for(i=0;i<c.size();i=j) {
+        j = i + 1;
+        /* The root row was sent by flushChanges() */
+        if(c[i] == 0) continue;
+        node = r->node + c[i];
+        p = _parent[node];
+        while(j < c.size() && c[j] == c[j - 1] + 1 && _parent[r->node + c[j]] == p) j++;
+        row = node - _first[p];
+        emit dataChanged(createIndex(row, _frozen ? NAME_COLUMN : VALUE_COLUMN, node),
+                         createIndex(row + j - i - 1, _frozen ? CHANGES_COLUMN : VALUE_COLUMN,
+                                     r->node + c[j - 1]));
+    }
+    c.clear();
+}
+
+
+/* Where the node ends in bits from the start of the tag.  A node runs up
+   to where the next one at the same level starts, so padding goes with
+   the member in front of it. */
+uint32_t
+TagModel::_nodeEnd(uint32_t node) const {
+    uint32_t p;
+
+    while((p = _parent[node]) != NODE_NONE) {
+        if(node + 1 < _first[p] + _children[p]) return _bitoffset[node + 1];
+        node = p;
+    }
+    return _rootNodes.at(node)->h.size * 8;
+}
+
+
+/* True if the node is different from when we were frozen.  This is only
+   done for the rows that the view draws. */
+bool
+TagModel::_nodeChanged(uint32_t node) const {
+    RootTag *r = _rootOf(node);
+
+    if(!r->primed) return false;
+    return _bits_differ((const uint8_t *)r->data, (const uint8_t *)r->frozen, _bitoffset[node], _nodeEnd(node));
+}
+
+
+/* Counts the leaves of the tag that are different from the frozen copy.
+   Arrays that are too big to have nodes count each element as a leaf. */
+uint32_t
+TagModel::_frozenChanges(RootTag *r) const {
+    const uint8_t *data = (const uint8_t *)r->data;
+    const uint8_t *frozen = (const uint8_t *)r->frozen;
+    uint32_t count = 0, start, end, elembits;
+
+    if(memcmp(data, frozen, r->h.size) == 0) return 0;
+    for(uint32_t n=r->node;n<r->nodeEnd;n++) {
+        if(_children[n]) continue;
+        start = _bitoffset[n];
+        end = _nodeEnd(n);
+        if(_count[n] <= 1 || _type[n] == DAX_CHAR) {
+            count += _bits_differ(data, frozen, start, end);
+        } else if(_type[n] == DAX_BOOL) {
+            count += _diff_bits(data, frozen, start, start + _count[n]);
+        } else {
+            elembits = (end - start) / _count[n];
+            count += _diff_elements(&data[start / 8], &frozen[start / 8], _count[n], elembits / 8);
+        }
+    }
+    return count;
+}
+
+
+/* Copies the current data of every tag into the frozen plane.  It's one
+   copy for each chunk of the arena instead of one for each tag. */
+void
+TagModel::freeze(void) {
+    if(_arena->planes() < 3) return;
+    for(const ArenaChunk &c : _arena->chunks()) {
+        memcpy(c.base + 2 * c.size, c.base, c.used);
+    }
+    _frozen = true;
+    for(RootTag *r : _rows) {
+        r->frozenChanges = 0;
+        r->dirty = true;
+        r->full = true;
+    }
+    flushChanges();
+}
+
+
+/* The rows are flushed while we are still frozen so that the signals
+   cover all of the columns.  The view doesn't ask for the data until it
+   paints, after we have thawed. */
+void
+TagModel::thaw(void) {
+    if(!_frozen) return;
+    for(RootTag *r : _rows) {
+        r->dirty = true;
+        r->full = true;
+    }
+    flushChanges();
+    _frozen = false;
+}
+
+
+template<typename T>
+static double
+_get(const uint8_t *p) {
+    T x;
+    memcpy(&x, p, sizeof(T));
+    return (double)x;
+}
+
+
+template<typename T>
+static int
+_cmp(const uint8_t *a, const uint8_t *b) {
+    T x, y;
+    memcpy(&x, a, sizeof(T));
+    memcpy(&y, b, sizeof(T));
+    return (x > y) - (x < y);
+}
+
+
+/* Gets the value of a scalar node as a double straight from the data that
+   we read.  Returns false for anything that isn't a single number. */
+bool
+TagModel::_numeric(uint32_t node, double *value) const {
+    const uint8_t *data = (const uint8_t *)_rootOf(node)->data;
+    uint32_t bits = _bitoffset[node];
+    const uint8_t *p;
+
+    if(_count[node] != 1 || data == nullptr) return false;
+    p = &data[bits / 8];
+    switch(_type[node]) {
+        case DAX_BOOL:  *value = (*p >> (bits % 8)) & 0x01; break;
+        case DAX_BYTE:  *value = _get<uint8_t>(p);  break;
+        case DAX_SINT:
+        case DAX_CHAR:  *value = _get<int8_t>(p);   break;
+        case DAX_WORD:
+        case DAX_UINT:  *value = _get<uint16_t>(p); break;
+        case DAX_INT:   *value = _get<int16_t>(p);  break;
+        case DAX_DWORD:
+        case DAX_UDINT: *value = _get<uint32_t>(p); break;
+        case DAX_DINT:  *value = _get<int32_t>(p);  break;
+        case DAX_LWORD:
+        case DAX_ULINT: *value = _get<uint64_t>(p); break;
+        case DAX_LINT:
+        case DAX_TIME:  *value = _get<int64_t>(p);  break;
+        case DAX_REAL:  *value = _get<float>(p);    break;
+        case DAX_LREAL: *value = _get<double>(p);   break;
+        default:
+            return false;
+    }
+    return true;
+}
+
+
+/* Numbers sort before strings and NaN's sort after the other numbers.
+   Everything else, arrays and structures, is equal so the proxy leaves
+   them in the order that the server gave us. */
+int
+TagModel::_compareValues(uint32_t a, uint32_t b) const {
+    const uint8_t *pa, *pb;
+    double x, y;
+    bool nx, ny;
+
+    nx = _numeric(a, &x);
+    ny = _numeric(b, &y);
+    if(nx && ny) {
+        if(x != x || y != y) return (x != x) - (y != y);
+        pa = &((const uint8_t *)_rootOf(a)->data)[_bitoffset[a] / 8];
+        pb = &((const uint8_t *)_rootOf(b)->data)[_bitoffset[b] / 8];
+        /* 64 bit integers don't all fit in a double */
+        if(_type[a] == _type[b]) {
+            switch(_type[a]) {
+                case DAX_LWORD:
+                case DAX_ULINT:
+                    return _cmp<uint64_t>(pa, pb);
+                case DAX_LINT:
+                case DAX_TIME:
+                    return _cmp<int64_t>(pa, pb);
+            }
+        }
+        return (x > y) - (x < y);
+    }
+    if(nx != ny) return nx ? -1 : 1;
+    if(_type[a] == DAX_CHAR && _type[b] == DAX_CHAR && !_rootOf(a)->paged && !_rootOf(b)->paged) {
+        pa = &((const uint8_t *)_rootOf(a)->data)[_bitoffset[a] / 8];
+        pb = &((const uint8_t *)_rootOf(b)->data)[_bitoffset[b] / 8];
+        QByteArray sa((const char *)pa, strnlen((const char *)pa, _count[a]));
+        QByteArray sb((const char *)pb, strnlen((const char *)pb, _count[b]));
+        return sa.compare(sb);
+    }
+    return 0;
+}
+
+
+/* Compares two rows that have the same parent on the given column.  Less
+   than zero means left goes first. */
+int
+TagModel::compare(const QModelIndex &left, const QModelIndex &right) const {
+    uint32_t a = left.internalId();
+    uint32_t b = right.internalId();
+
+    switch(left.column()) {
+        case NAME_COLUMN:
+            /* Elements of the same array sort by their index */
+            if(_name[a] == NAME_ELEMENT || _name[b] == NAME_ELEMENT) return (a > b) - (a < b);
+            if(_name[a] == _name[b]) return 0;
+            return _names[_name[a]].compare(_names[_name[b]]);
+        case TYPE_COLUMN:
+            return _typeString(_type[a], _count[a]).compare(_typeString(_type[b], _count[b]));
+        case VALUE_COLUMN:
+            return _compareValues(a, b);
+        case STATS_COLUMN:
+            if(_parent[a] != NODE_NONE) return 0;
+            return _rootNodes.at(a)->stats.compare(_rootNodes.at(b)->stats);
+        case CHANGES_COLUMN:
+            if(_parent[a] != NODE_NONE) return 0;
+            return (_rootNodes.at(a)->frozenChanges > _rootNodes.at(b)->frozenChanges) -
+                   (_rootNodes.at(a)->frozenChanges < _rootNodes.at(b)->frozenChanges);
+    }
+    return 0;
+}
+
+
+QString
+TagModel::_typeString(tag_type type, uint32_t count) const {
+    quint64 key = ((quint64)type << 32) | count;
+    std::string *typestr;
+    QString str;
+
+    auto it = _typeNames.constFind(key);
+    if(it != _typeNames.constEnd()) return it.value();
+    typestr = dax->typeString(type, count);
+    str = typestr->c_str();
+    delete typestr;
+    _typeNames.insert(key, str);
+    return str;
+}
+
+
+QString
+TagModel::_nodeName(uint32_t node) const {
+    uint32_t p = _parent[node];
+
+    if(p == NODE_NONE) return _names[_name[node]];
+    if(_name[node] == NAME_ELEMENT) {
+        return _nodeName(p) + "[" + QString::number(node - _first[p]) + "]";
+    }
+    return _nodeName(p) + "." + _names[_name[node]];
+}
+
+
+RootTag *
+TagModel::_rootOf(uint32_t node) const {
+    while(_parent[node] != NODE_NONE) node = _parent[node];
+    return _rootNodes.at(node);
+}
+
+
+QString
+TagModel::_valueString(uint32_t node) const {
+    const uint8_t *data = (const uint8_t *)_rootOf(node)->data;
+    uint32_t bits = _bitoffset[node];
+    tag_type type = _type[node];
+
+    if(data == nullptr) return QString();
+    if(_count[node] > 1) {
+        if(type == DAX_CHAR) {
+            return QString::fromLatin1((const char *)&data[bits / 8],
+                                       strnlen((const char *)&data[bits / 8], _count[node]));
+        }
+        return QString();
+    }
+    if(dax->isCustom(type)) return QString();
+    if(type == DAX_BOOL) {
+        return (data[bits / 8] & (0x01 << (bits % 8))) ? _true : _false;
+    }
+    return QString(dax->valueString(type, (void *)&data[bits / 8], 0).c_str());
+}
+
+
+QModelIndex
+TagModel::index(int row, int column, const QModelIndex &parent) const {
+    uint32_t node;
+
+    if(!hasIndex(row, column, parent)) return QModelIndex();
+    if(parent.isValid()) node = _first[parent.internalId()] + row;
+    else                 node = _rows[row]->node;
+    return createIndex(row, column, (quintptr)node);
+}
+
+
+QModelIndex
+TagModel::parent(const QModelIndex &index) const {
+    uint32_t p, pp;
+
+    if(!index.isValid()) return QModelIndex();
+    p = _parent[index.internalId()];
+    if(p == NODE_NONE) return QModelIndex();
+    pp = _parent[p];
+    if(pp == NODE_NONE) return createIndex(_rootNodes.at(p)->row, 0, (quintptr)p);
+    return createIndex(p - _first[pp], 0, (quintptr)p);
+}
+
+
+int
+TagModel::rowCount(const QModelIndex &parent) const {
+    if(!parent.isValid()) return _rows.size();
+    if(parent.column() > 0) return 0;
+    return _children[parent.internalId()];
+}
+
+
+int
+TagModel::columnCount(const QModelIndex &parent) const {
+    return TAG_COLUMNS;
+}
+
+
+QVariant
+TagModel::data(const QModelIndex &index, int role) const {
+    uint32_t node;
+
+    if(!index.isValid()) return QVariant();
+    node = index.internalId();
+    if(role == Qt::BackgroundRole) {
+        if(_frozen && _nodeChanged(node)) return QBrush(QColor(255, 230, 140));
+        return QVariant();
+    }
+    if(role == Qt::ForegroundRole || role == Qt::ToolTipRole) {
+        RootTag *r = _rootOf(node);
+        if(!r->stale) return QVariant();
+        if(role == Qt::ForegroundRole) return QBrush(Qt::gray);
+        return QString("Last read %1 s ago")
+                   .arg((QDateTime::currentMSecsSinceEpoch() - r->lastRead) / 1000.0, 0, 'f', 1);
+    }
+    if(role != Qt::DisplayRole) return QVariant();
+    switch(index.column()) {
+        case NAME_COLUMN:
+            return _nodeName(node);
+        case TYPE_COLUMN:
+            return _typeString(_type[node], _count[node]);
+        case VALUE_COLUMN:
+            return _valueString(node);
+        case STATS_COLUMN:
+            if(_parent[node] == NODE_NONE) return _rootNodes.at(node)->stats;
+            break;
+        case CHANGES_COLUMN:
+            if(_frozen && _parent[node] == NODE_NONE) return _rootNodes.at(node)->frozenChanges;
+            break;
+    }
+    return QVariant();
+}
+
+
+QVariant
+TagModel::headerData(int section, Qt::Orientation orientation, int role) const {
+    static const char *labels[] = {"Tagname", "Type", "Value", "Statistics", "Changed"};
+
+    if(orientation != Qt::Horizontal || role != Qt::DisplayRole) return QVariant();
+    if(section < 0 || section >= TAG_COLUMNS) return QVariant();
+    return QString(labels[section]);
+}
+
+
+RootTag *
+TagModel::rootOf(const QModelIndex &index) {
+    if(!index.isValid()) return nullptr;
+    return _rootOf(index.internalId());
+}
+
+
+QModelIndex
+TagModel::rootIndex(RootTag *r) {
+    return createIndex(r->row, 0, (quintptr)r->node);
+}
+
+
+QString
+TagModel::nodeName(const QModelIndex &index) {
+    if(!index.isValid()) return QString();
+    return _nodeName(index.internalId());
+}
+
+
+/* Name of the nth child of the root node of r */
+QString
+TagModel::childName(RootTag *r, int n) {
+    return _nodeName(_first[r->node] + n);
+}
+
+
+tag_type
+TagModel::nodeType(const QModelIndex &index) {
+    return _type[index.internalId()];
+}
+
+
+uint32_t
+TagModel::nodeCount(const QModelIndex &index) {
+    return _count[index.internalId()];
+}
+
+
+/* Top level arrays, other than strings, and structures can't be written
+   from the edit box */
+bool
+TagModel::isWritable(const QModelIndex &index) {
+    uint32_t node = index.internalId();
+
+    if(_parent[node] != NODE_NONE) return true;
+    if(_count[node] > 1 && _type[node] != DAX_CHAR) return false;
+    return !dax->isCustom(_type[node]);
+}
+
+
+bool
+TagModel::isReadonly(const QModelIndex &index) {
+    return _rootOf(index.internalId())->readonly;
+}
+
+
+/* We don't keep handles for the members so this asks the server for one */
+int
+TagModel::nodeHandle(const QModelIndex &index, tag_handle *h) {
+    if(!index.isValid()) return ERR_ARG;
+    return dax->getHandle(h, (char *)_nodeName(index.internalId()).toStdString().c_str());
+}
+
+
+TagSortModel::TagSortModel(QObject *parent) : QSortFilterProxyModel(parent) {
+    /* Rows that change are moved to their new place as they come in */
+    setDynamicSortFilter(true);
+}
+
+
+bool
+TagSortModel::lessThan(const QModelIndex &left, const QModelIndex &right) const {
+    return ((TagModel *)sourceModel())->compare(left, right) < 0;
+}
@@ -0,0 +1,254 @@
+/*  qDAX - An open source data acquisition and control system
+ *  Copyright (c) 2023 Phil Birkelbach
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+
+ *  Header file for the model that backs the tag tree
+ */
+
+#ifndef TAGMODEL_H
+#define TAGMODEL_H
+
+#include <QAbstractItemModel>
+#include <QSortFilterProxyModel>
+#include <QHash>
+#include <QThreadPool>
+#include <vector>
+#include <unordered_map>
+#include "dax.h"
+#include "arena.h"
+#include "eventworker.h"
+
+#define NAME_COLUMN 0
+#define TYPE_COLUMN 1
+#define VALUE_COLUMN 2
+#define STATS_COLUMN 3
+#define CHANGES_COLUMN 4
+#define TAG_COLUMNS 5
+
+/* Arrays larger than this don't get a node for each element.  They are
+   looked at with the array view instead. */
+#define ARRAY_ITEM_LIMIT 1000
+
+/* Arrays that are also bigger than this many bytes aren't read by the tree
+   at all.  We don't keep a copy of them and only the array view reads the
+   part that is on the screen. */
+#define ARRAY_POLL_LIMIT (64 * 1024)
+
+/* Arrays are compared with the frozen copy in blocks of about this many
+   bytes before we look at the elements one at a time */
+#define FREEZE_BLOCK_SIZE 64
+
+/* A refresh of at least this many bytes is looked at by more than one
+   thread, but never more than UPDATE_MAX_THREADS */
+#define UPDATE_PARALLEL_BYTES (256 * 1024)
+#define UPDATE_MAX_THREADS 8
+
+#define NODE_NONE 0xFFFFFFFF
+/* Name id used for array elements.  Their name is the index */
+#define NAME_ELEMENT 0xFFFFFFFF
+
+/* Kinds of step in a decode plan.  Each one has it's own scanner. */
+#define PLAN_BIT   0
+#define PLAN_BITS  1
+#define PLAN_8     2
+#define PLAN_16    3
+#define PLAN_32    4
+#define PLAN_64    5
+#define PLAN_BLOCK 6
+#define PLAN_BOOLS 7
+
+/* One leaf of a tag in the decode plan.  The node is relative to the root
+   node of the tag so the plan is still good after _compact(). */
+struct PlanStep {
+    uint32_t bit;     /* From the start of the tag */
+    uint32_t size;    /* Bits for PLAN_BITS and PLAN_BOOLS, bytes for PLAN_BLOCK */
+    uint32_t node;
+};
+
+/* Steps of the same kind that are next to each other in the plan */
+struct PlanRun {
+    uint8_t kind;
+    uint32_t first;
+    uint32_t count;
+};
+
+/* Activity counters for the hot tags panel */
+struct TagActivity {
+    uint64_t changes = 0;
+    uint64_t bytes = 0;
+    qint64 last = 0;
+};
+
+/* Everything that we keep for a top level tag.  The nodes for the tag and
+   all of it's members are the range [node, nodeEnd) in the node table. */
+struct RootTag {
+    tag_index idx;
+    tag_handle h;
+    int row;
+    uint32_t node;
+    uint32_t nodeEnd;
+    void *data;
+    void *prev;
+    void *frozen;     /* The data from when the model was frozen */
+    uint32_t frozenChanges; /* Leaves that are different from frozen */
+    bool primed;
+    bool readonly;
+    bool dirty;       /* Changed since the view was last told */
+    bool full;        /* Every row of the tag has to be redrawn */
+    bool paged;       /* Too big to poll, data and prev are NULL */
+    std::vector<PlanStep> plan;  /* The leaves sorted by offset */
+    std::vector<PlanRun> runs;
+    uint32_t planLeaves;         /* Most nodes that the plan can return */
+    std::vector<uint32_t> changed; /* Leaves that changed, relative nodes */
+    QString typeName;
+    QString stats;
+    TagActivity activity;
+    int pollInterval; /* Adaptive polling, zero until the first poll */
+    qint64 nextPoll;
+    qint64 lastRead;
+    qint64 considered; /* Tick that the scheduler last looked at it */
+    uint64_t version; /* Of the value cache entry that data matches */
+    bool stale;       /* Overdue for a read by more than the stale time */
+    std::vector<TagActivity> members; /* One for each child of the root node */
+};
+
+/* A member of a compound data type.  The offset is in bits from the start
+   of the structure and elembits is the size of one element in bits. */
+struct TypeMember {
+    uint32_t name;
+    tag_type type;
+    uint32_t count;
+    uint32_t bitoffset;
+    uint32_t elembits;
+};
+
+/* The tree is stored as a struct of arrays with one entry per node.  The
+   children of a node are always next to each other in the table so we only
+   need the first one and the count.  Names are interned and the display
+   strings are built when the view asks for them. */
+class TagModel : public QAbstractItemModel
+{
+    Q_OBJECT
+    friend class TagCache;
+    friend class Snapshot;
+
+    private:
+        Dax *dax;
+        TagArena *_arena;
+
+        std::vector<uint32_t> _parent;
+        std::vector<uint32_t> _first;
+        std::vector<uint32_t> _children;
+        std::vector<uint32_t> _bitoffset;
+        std::vector<uint32_t> _count;
+        std::vector<tag_type> _type;
+        std::vector<uint32_t> _name;
+        uint32_t _holes;
+
+        bool _frozen;
+        qint64 _staleTime;
+        QThreadPool _pool;
+
+        std::vector<RootTag *> _rows;
+        QHash<tag_index, RootTag *> _tags;
+        std::unordered_map<uint32_t, RootTag *> _rootNodes;
+
+        std::vector<QString> _names;
+        QHash<QString, uint32_t> _nameIds;
+        std::unordered_map<tag_type, std::vector<TypeMember>> _layouts;
+        mutable QHash<quint64, QString> _typeNames;
+
+        uint32_t _intern(QString name);
+        uint32_t _newNodes(uint32_t count);
+        RootTag *_newRoot(dax_tag tag, const tag_handle &h);
+        const std::vector<TypeMember> *_layout(tag_type type, QString instance, uint32_t bitoffset);
+        void _build(uint32_t node, QString name, uint32_t elembits);
+        void _compact(void);
+        void _compile(RootTag *r);
+        void _emitChanged(RootTag *r);
+        bool _countChanges(RootTag *r, qint64 now);
+        uint32_t _nodeEnd(uint32_t node) const;
+        bool _nodeChanged(uint32_t node) const;
+        uint32_t _frozenChanges(RootTag *r) const;
+        void _updateStats(RootTag *r);
+        QString _typeString(tag_type type, uint32_t count) const;
+        QString _valueString(uint32_t node) const;
+        QString _nodeName(uint32_t node) const;
+        RootTag *_rootOf(uint32_t node) const;
+        bool _numeric(uint32_t node, double *value) const;
+        int _compareValues(uint32_t a, uint32_t b) const;
+
+    public:
+        TagModel(Dax *dax, TagArena *arena, QObject *parent = nullptr);
+        ~TagModel();
+
+        QModelIndex index(int row, int column, const QModelIndex &parent = QModelIndex()) const override;
+        QModelIndex parent(const QModelIndex &index) const override;
+        int rowCount(const QModelIndex &parent = QModelIndex()) const override;
+        int columnCount(const QModelIndex &parent = QModelIndex()) const override;
+        QVariant data(const QModelIndex &index, int role = Qt::DisplayRole) const override;
+        QVariant headerData(int section, Qt::Orientation orientation, int role = Qt::DisplayRole) const override;
+
+        int addTag(dax_tag tag, const tag_handle *h = nullptr);
+        void addTags(const QList<TagInfo> &tags);
+        void removeTag(tag_index idx);
+        void removeTags(const QList<tag_index> &tags);
+        void clear(void);
+        void forgetTypes(void);
+        bool matches(RootTag *r, dax_tag tag);
+        bool rebind(RootTag *r, dax_tag tag);
+        void updateTag(RootTag *r, qint64 now);
+        void updateTags(qint64 now);
+        void updateTags(const std::vector<RootTag *> &tags, qint64 now);
+        void flushChanges(void);
+        void setStaleTime(qint64 msec) { _staleTime = msec; };
+        void markStale(qint64 now);
+        void freeze(void);
+        void thaw(void);
+        bool isFrozen(void) { return _frozen; };
+        int compare(const QModelIndex &left, const QModelIndex &right) const;
+
+        int rootCount(void) { return _rows.size(); };
+        RootTag *root(int row) { return _rows[row]; };
+        RootTag *rootTag(tag_index idx) { return _tags.value(idx, nullptr); };
+        RootTag *rootOf(const QModelIndex &index);
+        QModelIndex rootIndex(RootTag *r);
+        QString nodeName(const QModelIndex &index);
+        QString childName(RootTag *r, int n);
+        tag_type nodeType(const QModelIndex &index);
+        uint32_t nodeCount(const QModelIndex &index);
+        bool isWritable(const QModelIndex &index);
+        bool isReadonly(const QModelIndex &index);
+        int nodeHandle(const QModelIndex &index, tag_handle *h);
+        size_t nodes(void) { return _parent.size() - _holes; };
+};
+
+
+/* Sorts the tag tree.  The comparisons go straight to the raw data in the
+   TagModel instead of comparing the display strings. */
+class TagSortModel : public QSortFilterProxyModel
+{
+    Q_OBJECT
+
+    protected:
+        bool lessThan(const QModelIndex &left, const QModelIndex &right) const override;
+
+    public:
+        TagSortModel(QObject *parent = nullptr);
+};
+
+#endif
@@ -0,0 +1,149 @@
+/*  qDAX - An open source data acquisition and control system
+ *  Copyright (c) 2023 Phil Birkelbach
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+
+ *  Source code file for the trace recorder
+ */
+
+#include <cstdio>
+#include <chrono>
+#include <mutex>
+#include <vector>
+#include <algorithm>
+#include <opendax.h>
+#include "trace.h"
+
+/* One thread's spans.  Only the owning thread writes to it.  head counts
+   every span that was ever written so the slot is head % TRACE_BUFFER_SIZE.
+   When a thread goes away the buffer is kept, so that it's spans are still
+   in the dump, and it's given to the next new thread. */
+struct TraceBuffer {
+    std::atomic<uint64_t> head{0};
+    std::atomic<bool> owned{true};
+    TraceSpan spans[TRACE_BUFFER_SIZE];
+};
+
+std::atomic<bool> Trace::_enabled{false};
+
+static std::mutex _lock;
+static std::vector<TraceBuffer *> _buffers;
+static uint32_t _nextTid = 1;
+
+/* Gives the buffer back when the thread exits */
+struct TraceThread {
+    TraceBuffer *buffer = nullptr;
+    uint32_t tid = 0;
+
+    ~TraceThread() {
+        if(buffer) buffer->owned.store(false, std::memory_order_release);
+    }
+};
+
+static thread_local TraceThread _thread;
+
+
+static TraceBuffer *
+_buffer(void) {
+    if(_thread.buffer) return _thread.buffer;
+    std::lock_guard<std::mutex> lock(_lock);
+    _thread.tid = _nextTid++;
+    for(TraceBuffer *b : _buffers) {
+        bool owned = false;
+        if(b->owned.compare_exchange_strong(owned, true)) {
+            _thread.buffer = b;
+            return b;
+        }
+    }
+    _thread.buffer = new TraceBuffer;
+    _buffers.push_back(_thread.buffer);
+    return _thread.buffer;
+}
+
+
+void
+Trace::enable(bool on) {
+    _enabled.store(on, std::memory_order_relaxed);
+}
+
+
+int64_t
+Trace::now(void) {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+
+void
+Trace::record(const char *name, int64_t start, int64_t end, int64_t index, int64_t bytes) {
+    TraceBuffer *b = _buffer();
+    uint64_t head = b->head.load(std::memory_order_relaxed);
+    TraceSpan &s = b->spans[head % TRACE_BUFFER_SIZE];
+
+    s.name = name;
+    s.start = start;
+    s.duration = end - start;
+    s.index = index;
+    s.bytes = bytes;
+    s.tid = _thread.tid;
+    b->head.store(head + 1, std::memory_order_release);
+}
+
+
+/* Writes everything that the buffers still hold, oldest first.  This is
+   meant to be done after tracing is turned off.  If a thread is still
+   recording the span that it's writing may come out torn. */
+int
+Trace::dump(const char *path) {
+    std::vector<TraceSpan> spans;
+    uint64_t head, first;
+    FILE *f;
+
+    {
+        std::lock_guard<std::mutex> lock(_lock);
+        for(TraceBuffer *b : _buffers) {
+            head = b->head.load(std::memory_order_acquire);
+            first = head > TRACE_BUFFER_SIZE ? head - TRACE_BUFFER_SIZE : 0;
+            for(uint64_t n=first;n<head;n++) spans.push_back(b->spans[n % TRACE_BUFFER_SIZE]);
+        }
+    }
+    std::sort(spans.begin(), spans.end(), [](const TraceSpan &a, const TraceSpan &b) {
+        return a.start < b.start;
+    });
+
+    f = fopen(path, "w");
+    if(f == NULL) return ERR_NOTFOUND;
+    fputs("{\"traceEvents\":[\n", f);
+    for(size_t n=0;n<spans.size();n++) {
+        const TraceSpan &s = spans[n];
+        fprintf(f, "{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f,"
+                   "\"args\":{\"index\":%lld,\"bytes\":%lld}}%s\n",
+                s.name, s.tid, s.start / 1000.0, s.duration / 1000.0,
+                (long long)s.index, (long long)s.bytes, n + 1 < spans.size() ? "," : "");
+    }
+    fputs("],\"displayTimeUnit\":\"ms\"}\n", f);
+    if(fclose(f)) return ERR_NOTFOUND;
+    return ERR_OK;
+}
+
+
+/* Throws away everything that has been recorded */
+void
+Trace::clear(void) {
+    std::lock_guard<std::mutex> lock(_lock);
+
+    for(TraceBuffer *b : _buffers) b->head.store(0, std::memory_order_release);
+}
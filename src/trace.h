@@ -0,0 +1,84 @@
+/*  qDAX - An open source data acquisition and control system
+ *  Copyright (c) 2023 Phil Birkelbach
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+
+ *  Header file for the trace recorder
+ */
+
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <cstdint>
+#include <atomic>
+
+/* Spans that each thread keeps.  When a thread fills it's buffer the
+   oldest spans are written over. */
+#define TRACE_BUFFER_SIZE 16384
+
+struct TraceSpan {
+    const char *name;   /* Always a string literal */
+    int64_t start;      /* Nanoseconds */
+    int64_t duration;
+    int64_t index;      /* Tag index or -1 */
+    int64_t bytes;
+    uint32_t tid;
+};
+
+/* Records spans of time into a ring buffer for each thread and writes
+   them out as Chrome trace event JSON, which chrome://tracing and Perfetto
+   can open.  Recording doesn't take any locks.  A thread only takes the
+   lock once, to get it's buffer, the first time it records anything.
+   When tracing is off a span costs one atomic load. */
+class Trace
+{
+    private:
+        static std::atomic<bool> _enabled;
+
+    public:
+        static bool enabled(void) { return _enabled.load(std::memory_order_relaxed); };
+        static void enable(bool on);
+        static int64_t now(void);
+        static void record(const char *name, int64_t start, int64_t end, int64_t index, int64_t bytes);
+        static int dump(const char *path);
+        static void clear(void);
+};
+
+/* Records a span from when it's made until it goes out of scope.  The
+   index and the byte count can be filled in along the way, once the call
+   that is being traced knows them. */
+class TraceScope
+{
+    private:
+        const char *_name;
+        int64_t _start;
+
+    public:
+        int64_t index;
+        int64_t bytes;
+
+        TraceScope(const char *name, int64_t index = -1, int64_t bytes = 0) {
+            _name = name;
+            _start = Trace::enabled() ? Trace::now() : -1;
+            this->index = index;
+            this->bytes = bytes;
+        };
+        ~TraceScope() {
+            if(_start >= 0) Trace::record(_name, _start, Trace::now(), index, bytes);
+        };
+};
+
+#endif
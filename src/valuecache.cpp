@@ -0,0 +1,170 @@
+/*  qDAX - An open source data acquisition and control system
+ *  Copyright (c) 2023 Phil Birkelbach
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+
+ *  Source code file for the client side tag value cache
+ */
+
+#include <cstring>
+#include <algorithm>
+#include "valuecache.h"
+
+
+/* The bits of the tag that a handle covers.  Only BOOL handles can start
+   or end in the middle of a byte. */
+ValueCache::Range
+ValueCache::_range(const tag_handle &h) {
+    Range r;
+
+    r.lo = (uint64_t)h.byte * 8;
+    if(h.type == DAX_BOOL) {
+        r.lo += h.bit;
+        r.hi = r.lo + h.count;
+    } else {
+        r.hi = r.lo + (uint64_t)h.size * 8;
+    }
+    return r;
+}
+
+
+/* Puts the data for handle h into the entry.  src starts at h.byte like
+   the buffers that we read into.  Returns true if anything changed. */
+bool
+ValueCache::_merge(Entry &e, const tag_handle &h, const uint8_t *src) {
+    Range r = _range(h);
+    uint8_t *dst;
+    uint8_t mask;
+    bool changed = false;
+
+    if(e.data.size() < (size_t)h.byte + h.size) e.data.resize(h.byte + h.size, 0);
+    dst = &e.data[h.byte];
+    if(r.lo % 8 == 0 && r.hi % 8 == 0) {
+        changed = memcmp(dst, src, (r.hi - r.lo) / 8) != 0;
+        if(changed) memcpy(dst, src, (r.hi - r.lo) / 8);
+        return changed;
+    }
+    /* BOOL's that don't fill their bytes leave the other bits alone */
+    for(uint64_t bit=r.lo;bit<r.hi;bit=(bit / 8 + 1) * 8) {
+        uint64_t end = std::min(r.hi, (bit / 8 + 1) * 8);
+        mask = (uint8_t)((0xFF << (bit % 8)) & (0xFF >> ((8 - end % 8) % 8)));
+        size_t n = bit / 8 - h.byte;
+        if((dst[n] ^ src[n]) & mask) {
+            dst[n] = (dst[n] & ~mask) | (src[n] & mask);
+            changed = true;
+        }
+    }
+    return changed;
+}
+
+
+/* Returns the version of the tag after the update */
+uint64_t
+ValueCache::update(const tag_handle &h, const void *data, int64_t now) {
+    std::lock_guard<std::mutex> lock(_lock);
+    Entry &e = _entries[h.index];
+
+    if(_merge(e, h, (const uint8_t *)data) || e.version == 0) e.version = ++_serial;
+    e.time = now;
+    e.last = _range(h);
+    return e.version;
+}
+
+
+/* Copies the cached value for h into data if it's fresh enough.  It is if
+   a change event covers it, or if the last update covered it and is no
+   older than maxAge.  If version is given and the value hasn't changed
+   since that version nothing is copied.  Returns false if the caller has
+   to go to the server. */
+bool
+ValueCache::fetch(const tag_handle &h, void *data, int64_t now, int64_t maxAge, uint64_t *version) {
+    std::lock_guard<std::mutex> lock(_lock);
+    Range r = _range(h);
+    bool fresh = false;
+
+    auto it = _entries.find(h.index);
+    if(it == _entries.end()) return false;
+    Entry &e = it->second;
+    if(e.data.size() < (size_t)h.byte + h.size) return false;
+    for(const Range &l : e.live) {
+        if(l.lo <= r.lo && r.hi <= l.hi) fresh = true;
+    }
+    if(!fresh && e.last.lo <= r.lo && r.hi <= e.last.hi && now - e.time <= maxAge) fresh = true;
+    if(!fresh) return false;
+    if(version) {
+        if(*version == e.version) return true;
+        *version = e.version;
+    }
+    memcpy(data, &e.data[h.byte], h.size);
+    return true;
+}
+
+
+/* Zero means that we've never seen the tag */
+uint64_t
+ValueCache::version(tag_index idx) {
+    std::lock_guard<std::mutex> lock(_lock);
+
+    auto it = _entries.find(idx);
+    return it == _entries.end() ? 0 : it->second.version;
+}
+
+
+/* The part of the tag that h covers has a change event on it, so whatever
+   we have is current for as long as the event is there */
+void
+ValueCache::subscribe(const tag_handle &h) {
+    std::lock_guard<std::mutex> lock(_lock);
+
+    _entries[h.index].live.push_back(_range(h));
+}
+
+
+void
+ValueCache::unsubscribe(const tag_handle &h) {
+    std::lock_guard<std::mutex> lock(_lock);
+    Range r = _range(h);
+
+    auto it = _entries.find(h.index);
+    if(it == _entries.end()) return;
+    std::vector<Range> &live = it->second.live;
+    for(auto l = live.begin(); l != live.end(); l++) {
+        if(l->lo == r.lo && l->hi == r.hi) {
+            live.erase(l);
+            return;
+        }
+    }
+}
+
+
+/* The tag was deleted.  The server can give the index to a new tag so
+   nothing that we have for it, live ranges included, can be kept. */
+void
+ValueCache::remove(tag_index idx) {
+    std::lock_guard<std::mutex> lock(_lock);
+
+    _entries.erase(idx);
+}
+
+
+/* Nothing is good after the connection goes away.  Tag indexes can even
+   belong to other tags after a reconnect. */
+void
+ValueCache::clear(void) {
+    std::lock_guard<std::mutex> lock(_lock);
+
+    _entries.clear();
+}
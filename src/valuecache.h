@@ -0,0 +1,71 @@
+/*  qDAX - An open source data acquisition and control system
+ *  Copyright (c) 2023 Phil Birkelbach
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+
+ *  Header file for the client side tag value cache
+ */
+
+#ifndef VALUECACHE_H
+#define VALUECACHE_H
+
+#include <opendax.h>
+#include <mutex>
+#include <vector>
+#include <unordered_map>
+
+/* The last value that we have seen for each tag, no matter where it came
+   from.  The tag tree's polls, the watch events and the one off reads all
+   put what they get in here, so before one of them goes to the server it
+   can see if someone else already has a fresh enough copy.  The data for a
+   tag is the whole tag, from byte zero, and handles to members fill in
+   their part of it.  Events come in on the event thread so everything is
+   behind the lock. */
+class ValueCache
+{
+    private:
+        struct Range {
+            uint64_t lo;    /* Bits from the start of the tag */
+            uint64_t hi;
+        };
+        struct Entry {
+            std::vector<uint8_t> data;
+            uint64_t version = 0;  /* New every time the value changes */
+            int64_t time = 0;      /* Of the last update, which covered [last.lo, last.hi) */
+            Range last = {0, 0};
+            std::vector<Range> live; /* Ranges that have change events on them */
+        };
+
+        std::mutex _lock;
+        std::unordered_map<tag_index, Entry> _entries;
+        /* Versions come from one counter that clear() doesn't reset so a
+           version that a view kept from before can't match a new value */
+        uint64_t _serial = 0;
+
+        static Range _range(const tag_handle &h);
+        static bool _merge(Entry &e, const tag_handle &h, const uint8_t *src);
+
+    public:
+        uint64_t update(const tag_handle &h, const void *data, int64_t now);
+        bool fetch(const tag_handle &h, void *data, int64_t now, int64_t maxAge, uint64_t *version = nullptr);
+        uint64_t version(tag_index idx);
+        void subscribe(const tag_handle &h);
+        void unsubscribe(const tag_handle &h);
+        void remove(tag_index idx);
+        void clear(void);
+};
+
+#endif
@@ -20,83 +20,404 @@
  */
 
 #include <iostream>
+#include <cstring>
 #include "qdax.h"
 #include "watchitem.h"
+#include <QDateTime>
 
-extern Dax dax;
 
-WatchItem::WatchItem(QTreeWidget *parent, QString tagname) : QTreeWidgetItem(parent) {
-    std::string valstr;
+/* Returns the text for a value of the given type that starts bitoffset
+   bits into data.  Arrays other than strings and structures are blank. */
+static QString
+_value_text(Dax *dax, tag_type type, uint32_t count, const uint8_t *data, uint32_t bitoffset) {
+    const uint8_t *p = &data[bitoffset / 8];
+
+    if(count > 1) {
+        if(type == DAX_CHAR) return QString::fromLatin1((const char *)p, strnlen((const char *)p, count));
+        return QString();
+    }
+    if(dax->isCustom(type)) return QString();
+    if(type == DAX_BOOL) {
+        return (*p & (0x01 << (bitoffset % 8))) ? "true" : "false";
+    }
+    return QString(dax->valueString(type, (void *)p, 0).c_str());
+}
+
+
+WatchLeaf::WatchLeaf(QTreeWidgetItem *parent, QString name, tag_type type, uint32_t count,
+                     uint32_t bitoffset, uint32_t elembits) : QTreeWidgetItem(parent, ITEM_TYPE_LEAF) {
+    this->type = type;
+    this->count = count;
+    this->bitoffset = bitoffset;
+    if(type == DAX_BOOL && count == 1) bytes = 0;
+    else                               bytes = (count * elembits + 7) / 8;
+    setData(0, Qt::DisplayRole, name);
+}
+
+
+WatchNotifier::WatchNotifier(QObject *parent) : QObject(parent) {
+    _nextId = 0;
+    QObject::connect(this, &WatchNotifier::changed, this, &WatchNotifier::_show, Qt::QueuedConnection);
+}
+
+
+int
+WatchNotifier::add(WatchItem *item) {
+    _items.insert(_nextId, item);
+    return _nextId++;
+}
+
+
+void
+WatchNotifier::remove(int id) {
+    _items.remove(id);
+}
+
+
+void
+WatchNotifier::_show(int id, QByteArray data, QList<int> leaves) {
+    WatchItem *item = _items.value(id, nullptr);
+
+    if(item) item->show(data, leaves);
+}
+
+
+/* If subscribe is false the item is only a placeholder.  The caller is
+   expected to go through resolve(), allocate() and addEvent() itself, which
+   is how a WatchLoader restores a whole watchlist at once. */
+WatchItem::WatchItem(QTreeWidget *parent, Dax *dax, TagArena *arena, ValueCache *cache, WatchNotifier *notifier, QString tagname, bool subscribe) : QTreeWidgetItem(parent) {
     int result;
 
+    this->dax = dax;
+    this->arena = arena;
+    this->cache = cache;
+    _notifier = notifier;
+    _id = notifier->add(this);
     setData(0, Qt::DisplayRole, tagname);
-    result = dax.getHandle(&h, (char *)tagname.toStdString().c_str());
+    data = NULL;
+    prev = NULL;
+    _size = 0;
+    memset(&_built, 0, sizeof(_built));
+    _subscribed = false;
+    _eventType = EVENT_CHANGE;
+    status = ERR_OK;
+    if(!subscribe) {
+        setData(1, Qt::DisplayRole, QString("<restoring>"));
+        return;
+    }
+    result = _subscribe();
     if(result) {
+        _notifier->remove(_id);
+        arena->free(data, _size);
         throw result;
     }
-    if(h.count > 1 && h.type != DAX_CHAR) {
-        throw ERR_2BIG;
+}
+
+
+/* Resolves the handle, gets the initial value and adds the change event.
+   This is used by the constructor and again after a reconnect. */
+int
+WatchItem::_subscribe(void) {
+    qint64 now;
+    int result;
+
+    result = resolve();
+    if(result) return result;
+    allocate();
+    /* The tag tree may have just read it */
+    now = QDateTime::currentMSecsSinceEpoch();
+    if(!cache->fetch(h, data, now, WATCH_CACHE_AGE)) {
+        if(dax->read(h, data) == ERR_OK) cache->update(h, data, now);
     }
+    memcpy(prev, data, h.size);
+    result = addEvent();
+    if(result) return result;
+    showValue();
+    return ERR_OK;
+}
+
+
+/* Gets the handle for the tag.  The name comes from the item so this is
+   only for the GUI thread.  A WatchLoader looks up the names itself and
+   gives the items their handles with setHandle(). */
+int
+WatchItem::resolve(void) {
+    tag_handle newh;
+    int result;
+
+    result = dax->getHandle(&newh, (char *)text(0).toStdString().c_str());
+    if(result) return result;
     //DF("index = %d, byte = %d, count = %d",h.index, h.byte, h.count);
-    data = malloc(h.size);
-    dax.read(h, data);
+    h = newh;
+    return ERR_OK;
+}
+
+
+/* Makes sure that the buffer is big enough for the handle that we got
+   from resolve() and builds the leaves for arrays and structures.  The
+   arena and the tree belong to the GUI thread. */
+void
+WatchItem::allocate(void) {
+    if(data == NULL || h.size != _size) {
+        arena->free(data, _size);
+        data = arena->alloc(h.size);
+        _size = h.size;
+    }
+    prev = arena->plane(data, 1);
+    memset(data, 0, _size);
+    memset(prev, 0, _size);
+
+    if(h.type != _built.type || h.count != _built.count || h.size != _built.size ||
+       h.byte != _built.byte || h.bit != _built.bit) {
+        qDeleteAll(takeChildren());
+        _leaves.clear();
+        _layouts.clear();
+        _build(this, text(0), h.type, h.count, h.bit, h.type == DAX_BOOL ? 1 : h.size * 8 / h.count);
+        _built = h;
+    }
+}
+
+
+/* Works out the member offsets of a compound type from the handles of the
+   members of one instance.  Every other instance of the type has the same
+   layout so we only do this once per type. */
+const std::vector<WatchMember> &
+WatchItem::_layout(tag_type type, QString instance, uint32_t bitoffset) {
+    std::vector<WatchMember> layout;
+    WatchMember wm;
+    tag_handle mh;
+    QString name;
+
+    auto it = _layouts.find(type);
+    if(it != _layouts.end()) return it->second;
+    for(cdt_iter m : dax->getTypeMembers(type)) {
+        name = instance + "." + m.name;
+        if(dax->getHandle(&mh, (char *)name.toStdString().c_str())) continue;
+        wm.name = m.name;
+        wm.type = m.type;
+        wm.count = m.count;
+        wm.bitoffset = mh.byte * 8 + mh.bit - h.byte * 8 - bitoffset;
+        wm.elembits = m.type == DAX_BOOL ? 1 : mh.size * 8 / mh.count;
+        layout.push_back(wm);
+    }
+    return _layouts.emplace(type, layout).first->second;
+}
+
+
+/* Adds the elements or members of a value as children of parent.  Only the
+   leaves that show a value go in _leaves to be checked on each event. */
+void
+WatchItem::_build(QTreeWidgetItem *parent, QString name, tag_type type, uint32_t count,
+                  uint32_t bitoffset, uint32_t elembits) {
+    WatchLeaf *leaf;
+    QString leafname;
 
+    if(count > 1) {
+        /* Strings are shown whole */
+        if(type == DAX_CHAR || count > WATCH_ITEM_LIMIT) return;
+        for(uint32_t n=0;n<count;n++) {
+            leafname = name + "[" + QString::number(n) + "]";
+            leaf = new WatchLeaf(parent, leafname, type, 1, bitoffset + n * elembits, elembits);
+            if(dax->isCustom(type)) _build(leaf, leafname, type, 1, leaf->bitoffset, 0);
+            else                    _leaves.push_back(leaf);
+        }
+    } else if(dax->isCustom(type)) {
+        for(const WatchMember &m : _layout(type, name, bitoffset)) {
+            leafname = name + "." + m.name;
+            leaf = new WatchLeaf(parent, leafname, m.type, m.count, bitoffset + m.bitoffset, m.elembits);
+            if((m.count > 1 && m.type != DAX_CHAR && m.count <= WATCH_ITEM_LIMIT) || dax->isCustom(m.type)) {
+                _build(leaf, leafname, m.type, m.count, leaf->bitoffset, m.elembits);
+            } else {
+                _leaves.push_back(leaf);
+            }
+        }
+    }
+}
+
+
+/* A filter's value is converted to the type of the tag and goes to the
+   server with the event so that the values that don't pass never leave the
+   server.  The filters only make sense for a single number. */
+int
+WatchItem::addEvent(void) {
+    void *filter = NULL;
+    int result;
 
-    result = dax.eventAdd(&h, EVENT_CHANGE, NULL, &event_id, _update_tag, this, NULL);
+    if(_eventType != EVENT_CHANGE) {
+        if(h.count != 1 || h.type == DAX_BOOL || dax->isCustom(h.type)) return ERR_BADTYPE;
+        _eventData.assign(h.size, 0);
+        result = dax->value(_eventValue.toStdString(), h.type, _eventData.data(), 0);
+        if(result) return result;
+        filter = _eventData.data();
+    }
+    result = dax->eventAdd(&h, _eventType, filter, &event_id, _update_tag, this, NULL);
+    if(result) return result;
+    result = dax->eventOptions(event_id, EVENT_OPT_SEND_DATA);
     if(result) {
-        free(data);
-        throw result;
+        dax->eventDelete(event_id);
+        return result;
     }
-    result = dax.eventOptions(event_id, EVENT_OPT_SEND_DATA);
+    /* From here on the event keeps the cache up to date for this part of
+       the tag, unless it's filtered and we don't see every change.  The
+       data may have come from the cache so it's only put there by whoever
+       actually read it. */
+    if(_eventType == EVENT_CHANGE) cache->subscribe(h);
+    _subscribed = true;
+    return ERR_OK;
+}
+
+
+/* Changes the event that the watch uses.  If the new one can't be added
+   we go back to the one that we had. */
+int
+WatchItem::setFilter(int type, QString value) {
+    int oldType = _eventType;
+    QString oldValue = _eventValue;
+    int result;
+
+    _eventType = type;
+    _eventValue = type == EVENT_CHANGE ? QString() : value;
+    setToolTip(0, filterText());
+    setToolTip(1, filterText());
+    if(!_subscribed) return ERR_OK;
+    dax->eventDelete(event_id);
+    if(oldType == EVENT_CHANGE) cache->unsubscribe(h);
+    _subscribed = false;
+    result = addEvent();
     if(result) {
-        free(data);
-        throw result;
+        _eventType = oldType;
+        _eventValue = oldValue;
+        setToolTip(0, filterText());
+        setToolTip(1, filterText());
+        addEvent();
     }
-    if(h.count > 1 && h.type==DAX_CHAR) {
-        for(int n=0; n<h.count;n++) {
-            valstr += ((char *)data)[n];
-        }
-        setData(1, Qt::DisplayRole, QString(valstr.c_str()));
+    return result;
+}
+
+
+QString
+WatchItem::filterText(void) {
+    switch(_eventType) {
+        case EVENT_DEADBAND: return "Deadband " + _eventValue;
+        case EVENT_GREATER:  return "Greater than " + _eventValue;
+        case EVENT_LESS:     return "Less than " + _eventValue;
+        case EVENT_EQUAL:    return "Equal to " + _eventValue;
+    }
+    return QString();
+}
+
+
+/* The old event went away with the old connection so we just add a new one */
+int
+WatchItem::resubscribe(void) {
+    int result;
+
+    _subscribed = false;
+    result = _subscribe();
+    if(result) {
+        setData(1, Qt::DisplayRole, QString("<") + dax_errstr(result) + ">");
+    }
+    return result;
+}
+
+
+/* Shows everything and makes the current data the baseline for the next
+   event.  An event that's already been added may be writing the data. */
+void
+WatchItem::showValue(void) {
+    std::lock_guard<std::mutex> lock(_lock);
+
+    setData(1, Qt::DisplayRole, _value_text(dax, h.type, h.count, (uint8_t *)data, h.bit));
+    for(WatchLeaf *leaf : _leaves) {
+        leaf->setData(1, Qt::DisplayRole, _value_text(dax, leaf->type, leaf->count, (uint8_t *)data, leaf->bitoffset));
+    }
+    memcpy(prev, data, h.size);
+}
+
+
+/* Compares the data from an event with the last event and returns the
+   indexes of the leaves that changed.  A whole array or structure comes in
+   as one event but it's usually only a few members that are different.
+   This is on the event thread so it doesn't touch the tree. */
+QList<int>
+WatchItem::_diff(void) {
+    const uint8_t *d = (const uint8_t *)data;
+    const uint8_t *p = (const uint8_t *)prev;
+    QList<int> changed;
+    uint64_t bytes = 0;
+    bool diff;
+
+    if(_leaves.empty()) {
+        bytes = h.size;
     } else {
-        if(h.type == DAX_BOOL) {
-            if(((uint8_t *)data)[0] & (uint8_t)(0x01 << h.bit))
-                valstr = "true";
-            else
-                valstr = "false";
-        } else {
-            valstr = dax.valueString(h.type, data, 0);
+        for(size_t n=0;n<_leaves.size();n++) {
+            const WatchLeaf *leaf = _leaves[n];
+            const uint8_t *a = &d[leaf->bitoffset / 8];
+            const uint8_t *b = &p[leaf->bitoffset / 8];
+            if(leaf->bytes == 0) diff = ((*a ^ *b) >> (leaf->bitoffset % 8)) & 0x01;
+            else                 diff = memcmp(a, b, leaf->bytes) != 0;
+            if(!diff) continue;
+            changed.append((int)n);
+            bytes += leaf->bytes ? leaf->bytes : 1;
         }
-        setData(1, Qt::DisplayRole, QString(valstr.c_str()));
     }
+    changes.fetch_add(1, std::memory_order_relaxed);
+    changeBytes.fetch_add(bytes, std::memory_order_relaxed);
+    lastChange.store(QDateTime::currentMSecsSinceEpoch(), std::memory_order_relaxed);
+    memcpy(prev, data, h.size);
+    return changed;
 }
 
 
+/* The GUI thread gets its own copy of the data so that the next event can
+   come in while it's being shown */
 void
 WatchItem::_update_tag(Dax *d, void *udata) {
-    std::string valstr;
     WatchItem *item = (WatchItem *)udata;
+    std::lock_guard<std::mutex> lock(item->_lock);
+    QList<int> leaves;
 
-    dax.eventGetData(item->data, item->h.size);
-    if(item->h.count > 1 && item->h.type==DAX_CHAR) {
-        for(int n=0; n<item->h.count;n++) {
-            valstr += ((char *)item->data)[n];
-        }
-        item->setData(1, Qt::DisplayRole, QString(valstr.c_str()));
-    } else {
-        if(item->h.type == DAX_BOOL) {
-            if(((uint8_t *)item->data)[0] & (uint8_t)(0x01 << item->h.bit))
-                valstr = "true";
-            else
-                valstr = "false";
-        } else {
-            valstr = dax.valueString(item->h.type, item->data, 0);
-        }
-        item->setData(1, Qt::DisplayRole, QString(valstr.c_str()));
+    d->eventGetData(item->data, item->h.size);
+    item->cache->update(item->h, item->data, QDateTime::currentMSecsSinceEpoch());
+    leaves = item->_diff();
+    if(!item->_leaves.empty() && leaves.isEmpty()) return;
+    emit item->_notifier->changed(item->_id, QByteArray((const char *)item->data, item->h.size), leaves);
+}
+
+
+/* Shows the data from an event.  The leaves may have been rebuilt for a new
+   handle since the event came in, so we give up if it doesn't fit. */
+void
+WatchItem::show(const QByteArray &data, const QList<int> &leaves) {
+    const uint8_t *d = (const uint8_t *)data.constData();
+
+    if((uint32_t)data.size() != h.size) return;
+    if(_leaves.empty()) {
+        setData(1, Qt::DisplayRole, _value_text(dax, h.type, h.count, d, h.bit));
+        return;
     }
+    for(int n : leaves) {
+        if(n >= (int)_leaves.size()) continue;
+        _leaves[n]->setData(1, Qt::DisplayRole, _value_text(dax, _leaves[n]->type, _leaves[n]->count, d, _leaves[n]->bitoffset));
+    }
+}
+
+
+/* The server deleted the tag and the event went with it.  The cache has
+   already dropped the tag so there's nothing to unsubscribe from. */
+void
+WatchItem::tagDeleted(void) {
+    if(!_subscribed) return;
+    _subscribed = false;
+    setData(1, Qt::DisplayRole, QString("<deleted>"));
 }
 
 
 WatchItem::~WatchItem() {
-    dax.eventDelete(event_id);
-    free(data);
+    if(_subscribed) {
+        dax->eventDelete(event_id);
+        if(_eventType == EVENT_CHANGE) cache->unsubscribe(h);
+    }
+    _notifier->remove(_id);
+    arena->free(data, _size);
 }
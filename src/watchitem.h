@@ -24,7 +24,15 @@
 
 #include <QObject>
 #include <QTreeWidget>
+#include <QByteArray>
+#include <QHash>
+#include <atomic>
+#include <mutex>
+#include <vector>
+#include <unordered_map>
 #include "dax.h"
+#include "arena.h"
+#include "valuecache.h"
 
 #define NAME_COLUMN 0
 #define TYPE_COLUMN 1
@@ -33,21 +41,122 @@
 #define ITEM_TYPE_ROOT 1001
 #define ITEM_TYPE_LEAF 1002
 
+/* Arrays bigger than this are watched as a whole but their elements are
+   not shown */
+#define WATCH_ITEM_LIMIT 1000
+
+/* A value in the cache that is this new, in milliseconds, is used as the
+   first value of a watch instead of reading it */
+#define WATCH_CACHE_AGE 500
+
+/* One element or member of a watched array or structure.  The offset is in
+   bits from the start of the watch's buffer. */
+class WatchLeaf : public QTreeWidgetItem
+{
+    public:
+        tag_type type;
+        uint32_t count;
+        uint32_t bitoffset;
+        uint32_t bytes;     /* Zero for a single BOOL */
+
+        WatchLeaf(QTreeWidgetItem *parent, QString name, tag_type type, uint32_t count, uint32_t bitoffset, uint32_t elembits);
+};
+
+/* Layout of a member of a compound type relative to the start of the
+   structure */
+struct WatchMember {
+    QString name;
+    tag_type type;
+    uint32_t count;
+    uint32_t bitoffset;
+    uint32_t elembits;
+};
+
+class WatchItem;
+
+/* The events for the watchlist come in on the event thread.  A copy of the
+   data and the list of the leaves that changed are passed to the GUI thread
+   by a queued signal and the items are looked up by id there, so an item
+   that is deleted in the meantime is just missed. */
+class WatchNotifier : public QObject
+{
+    Q_OBJECT
+
+    private:
+        QHash<int, WatchItem *> _items;
+        int _nextId;
+
+    private slots:
+        void _show(int id, QByteArray data, QList<int> leaves);
+
+    signals:
+        void changed(int id, QByteArray data, QList<int> leaves);
+
+    public:
+        WatchNotifier(QObject *parent = nullptr);
+
+        int add(WatchItem *item);
+        void remove(int id);
+};
+
 class WatchItem : public QTreeWidgetItem
 {
     private:
         static void _update_tag(Dax *d, void *udata);
+        int _subscribe(void);
+        void _build(QTreeWidgetItem *parent, QString name, tag_type type, uint32_t count,
+                    uint32_t bitoffset, uint32_t elembits);
+        const std::vector<WatchMember> &_layout(tag_type type, QString instance, uint32_t bitoffset);
+        QList<int> _diff(void);
+        size_t _size;   /* Size of the buffer that we got from the arena */
+        bool _subscribed;
+        int _eventType;       /* EVENT_CHANGE or one of the filters */
+        QString _eventValue;  /* Deadband or threshold for a filter */
+        std::vector<uint8_t> _eventData;
+        WatchNotifier *_notifier;
+        int _id;
+        std::mutex _lock;   /* data and prev once the event has been added */
+        tag_handle _built;  /* Handle that the leaves were built for */
+        std::vector<WatchLeaf *> _leaves;
+        std::unordered_map<tag_type, std::vector<WatchMember>> _layouts;
 
     protected:
         tag_handle h;
         dax_id event_id;
+        Dax *dax;
+        TagArena *arena;
+        ValueCache *cache;
         void *data;
+        void *prev;   /* Data from the last event in the arena's second plane */
 
     public:
-        WatchItem(QTreeWidget *parent, QString tagname);
+        /* Activity counters for the hot tags panel.  These are bumped from
+           the event thread. */
+        std::atomic<uint64_t> changes{0};
+        std::atomic<uint64_t> changeBytes{0};
+        std::atomic<qint64> lastChange{0};
+
+        /* Result of the last resolve() or addEvent() when the item is
+           being subscribed in pieces by a WatchLoader */
+        int status;
+
+        WatchItem(QTreeWidget *parent, Dax *dax, TagArena *arena, ValueCache *cache, WatchNotifier *notifier, QString tagname, bool subscribe = true);
         ~WatchItem();
 
         tag_handle handle(void) { return h; };
+        void setHandle(const tag_handle &newh) { h = newh; };
+        void *buffer(void) { return data; };
+        int resubscribe(void);
+        void tagDeleted(void);
+        int resolve(void);
+        void allocate(void);
+        int addEvent(void);
+        void showValue(void);
+        void show(const QByteArray &data, const QList<int> &leaves);
+        int setFilter(int type, QString value);
+        int filterType(void) { return _eventType; };
+        QString filterValue(void) { return _eventValue; };
+        QString filterText(void);
 };
 
 
@@ -0,0 +1,101 @@
+/*  qDAX - An open source data acquisition and control system
+ *  Copyright (c) 2023 Phil Birkelbach
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+
+ *  Source code file for the worker that restores a saved watchlist
+ */
+
+#include <cstring>
+#include <vector>
+#include <algorithm>
+#include <QDateTime>
+#include "qdax.h"
+#include "watchloader.h"
+
+
+WatchLoader::WatchLoader(Dax *dax, ValueCache *cache, QList<WatchItem *> items) {
+    this->dax = dax;
+    _cache = cache;
+    _items = items;
+    for(WatchItem *item : _items) {
+        _names.append(item->text(0));
+    }
+    _handles.resize(_items.size());
+    _status.resize(_items.size(), ERR_OK);
+}
+
+
+void
+WatchLoader::resolve(void) {
+    for(int n=0;n<_names.size();n++) {
+        _status[n] = dax->getHandle(&_handles[n], (char *)_names[n].toStdString().c_str());
+    }
+    emit resolved();
+}
+
+
+/* The initial values are read a whole run of neighbouring watches at a
+   time instead of one read per watch.  Watches are usually members of a
+   few big tags so this turns thousands of reads into a handful. */
+void
+WatchLoader::subscribe(void) {
+    std::vector<WatchItem *> ok;
+    std::vector<uint8_t> buff;
+    tag_handle h, span;
+    uint32_t lo, hi;
+    size_t i, j;
+    int result;
+
+    for(WatchItem *item : _items) {
+        if(item->status == ERR_OK) ok.push_back(item);
+    }
+    std::sort(ok.begin(), ok.end(), [](WatchItem *a, WatchItem *b) {
+        tag_handle ha = a->handle(), hb = b->handle();
+        if(ha.index != hb.index) return ha.index < hb.index;
+        return ha.byte < hb.byte;
+    });
+
+    for(i=0;i<ok.size();i=j) {
+        span = ok[i]->handle();
+        lo = span.byte;
+        hi = span.byte + span.size;
+        for(j=i+1;j<ok.size();j++) {
+            h = ok[j]->handle();
+            if(h.index != span.index || h.byte > hi + WATCH_READ_GAP) break;
+            hi = std::max(hi, h.byte + h.size);
+        }
+        /* Read the run as raw bytes */
+        span.byte = lo;
+        span.bit = 0;
+        span.size = hi - lo;
+        span.count = span.size;
+        span.type = DAX_BYTE;
+        buff.resize(span.size);
+        result = dax->read(span, buff.data());
+        if(result == ERR_OK) _cache->update(span, buff.data(), QDateTime::currentMSecsSinceEpoch());
+        for(size_t k=i;k<j;k++) {
+            h = ok[k]->handle();
+            if(result) ok[k]->status = result;
+            else       memcpy(ok[k]->buffer(), &buff[h.byte - lo], h.size);
+        }
+    }
+
+    for(WatchItem *item : ok) {
+        if(item->status == ERR_OK) item->status = item->addEvent();
+    }
+    emit subscribed();
+}
@@ -0,0 +1,71 @@
+/*  qDAX - An open source data acquisition and control system
+ *  Copyright (c) 2023 Phil Birkelbach
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+
+ *  Header file for the worker that restores a saved watchlist
+ */
+
+#ifndef WATCHLOADER_H
+#define WATCHLOADER_H
+
+#include <QObject>
+#include <QList>
+#include <QStringList>
+#include <vector>
+#include "dax.h"
+#include "watchitem.h"
+
+/* Watches in the same tag that are closer together than this are read
+   with a single call */
+#define WATCH_READ_GAP 4096
+
+/* Subscribes a list of placeholder WatchItems from a worker thread.  It is
+   done in two steps because the buffers have to come from the arena on
+   the GUI thread.  resolve() gets the handles for the names, which are
+   copied when the loader is made, without touching the items.  When the
+   GUI sees resolved() it gives the items their handles and buffers and
+   then subscribe() does the reads and adds the events.  From then until
+   subscribed() the items belong to the loader.  The result for each item
+   is left in it's status. */
+class WatchLoader : public QObject
+{
+    Q_OBJECT
+
+    private:
+        Dax *dax;
+        ValueCache *_cache;
+        QList<WatchItem *> _items;
+        QStringList _names;
+        std::vector<tag_handle> _handles;
+        std::vector<int> _status;
+
+    public slots:
+        void resolve(void);
+        void subscribe(void);
+
+    signals:
+        void resolved(void);
+        void subscribed(void);
+
+    public:
+        WatchLoader(Dax *dax, ValueCache *cache, QList<WatchItem *> items);
+        QList<WatchItem *> items(void) { return _items; };
+        tag_handle handle(int n) { return _handles[n]; };
+        int status(int n) { return _status[n]; };
+};
+
+#endif